@@ -7,6 +7,10 @@
 #include <math.h>    // various math functions, such as exp()
 #include <stdio.h>   // various "input/output" functions
 #include <time.h>    // functions for timing computations
+#include <string.h>  // memcpy() and friends
+#if defined(__SSE2__)
+#include <immintrin.h>  // SIMD intrinsics used by the batch functions
+#endif
 
 
 // These functions are found in "4135FunctionLibrary.h".
@@ -14,6 +18,11 @@ double MTUniform (unsigned int);
 double LCGUniform (unsigned int);
 double MWCUniform (unsigned int);
 double LCG64Uniform (int unsigned);
+double ChiSquareTail (double, int);
+double ChiSquareTest (double (*)(unsigned int), int, int, double *);
+double SerialTest (double (*)(unsigned int), int, double *);
+double GapTest (double (*)(unsigned int), int, double *);
+double BirthdayTest (double (*)(unsigned int), int, double *);
 void   Pause ();
 double Histogram (double, double, double, int, int);
 double DiscreteHistogram (int, int, int, int);
@@ -22,11 +31,97 @@ void   ExponentialHistogram (double, int, int);
 void   UniformHistogram (double, int, int);
 int    Equal (double, double, double);
 double **Array (int, int);
+void   ArrayFree (double **);
 double PolarNormal ();
 double PsiTS (double);
 double Psi (double);
 double PsiInv (double);
+double StudentTInv (double, int);
+double PsiRA (double);
+void   PsiBatch (const double *, double *, int);
+void   PsiInvBatch (const double *, double *, int);
+void   PsiTSBatch (const double *, double *, int);
+void   LogBatch (const double *, double *, int);
+void   ExpBatch (const double *, double *, int);
+void   CosBatch (const double *, double *, int);
+void   ExponentialBatch (const double *, double *, int, double);
+int    VecSupported (int);
+int    VecForce (const char *);
+int    VecLevel ();
+const char *VecIsa ();
+enum {VEC_BASE, VEC_AVX2, VEC_AVX512};   // Instruction sets of the batch kernels
 void   CorrelatedNormals (double, double *);
+void   Cholesky (double *, int);
+void   CholeskyMultiply (const double *, int, const double *, double *, int);
 
 
+// Generators that keep their state in an object rather than in statics, so
+// that several streams (one per thread, say) can run side by side.
+typedef struct {
+   unsigned int X[624];   // Mersenne Twister state vector.
+   int i0;                // Index of the next word to temper.
+} MTState;
 
+typedef struct {
+   MTState mt;            // Source of the 32-bit words used by the ziggurat.
+} ZigguratNormal;
+
+void         MTUniformGetState (MTState *);
+void         MTUniformSetState (const MTState *);
+void         MTSeed (MTState *, unsigned int);
+unsigned int MTNext (MTState *);
+double       MTStateUniform (MTState *);
+void         ZigguratSeed (ZigguratNormal *, unsigned int);
+double       ZigguratDraw (ZigguratNormal *);
+void         ZigguratFill (ZigguratNormal *, double *, int);
+void         ZigguratCorrelatedNormals (ZigguratNormal *, double, double *);
+
+// Counter-based: the words for any counter come straight from (counter, key).
+void         Philox (const unsigned int *, const unsigned int *, unsigned int *);
+void         PhiloxBatch (const unsigned int *, const unsigned int *, unsigned int *, int);
+double       WordUniform (unsigned int);
+
+
+// A block of memory that allocations are carved out of (see ArenaAlloc).
+typedef struct {
+   void *block;           // What malloc returned for the current block.
+   char *base;            // Its usable space, rounded up to 64 bytes.
+   size_t size, used;     // Bytes in the current block and bytes handed out.
+   size_t below;          // Bytes handed out from the blocks before it.
+   size_t peak;           // Most bytes in use at any one time.
+   long long mallocs;     // Blocks taken from the heap so far.
+} Arena;
+
+// A contiguous row-major matrix of doubles (see MatrixCreate).
+typedef struct {
+   double *data;          // Entry (i,j) is data[i*stride+j].
+   int rows, cols;
+   int stride;            // Doubles from the start of one row to the next.
+   void *block;           // Heap block to free, or NULL (arenas and views).
+} Matrix;
+
+void         ArenaCreate (Arena *, size_t);
+void        *ArenaAlloc (Arena *, size_t);
+size_t       ArenaMark (Arena *);
+void         ArenaRelease (Arena *, size_t);
+void         ArenaReset (Arena *);
+void         ArenaFree (Arena *);
+Arena       *ThreadArena ();
+Matrix       MatrixCreate (int, int, Arena *);
+Matrix       MatrixView (Matrix, int, int, int, int);
+double      *MatrixRow (Matrix, int);
+double     **MatrixRows (Matrix);
+void         MatrixFree (Matrix *);
+
+
+// Walker's alias table for a distribution on 0, ..., n-1 (see AliasCreate).
+typedef struct {
+   int n;
+   double *prob;          // Chance that column i gives i rather than alias[i].
+   int *alias;
+} AliasTable;
+
+void         AliasCreate (AliasTable *, const double *, int);
+int          AliasDraw (const AliasTable *, double);
+void         AliasDrawBatch (const AliasTable *, const double *, int *, int);
+void         AliasFree (AliasTable *);
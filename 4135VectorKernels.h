@@ -0,0 +1,404 @@
+// The vector kernels of the function library: y[i] = f(x[i]) in blocks of
+// VEC_WIDTH values (see "Batch versions of Psi()" in 4135FunctionLibrary.h).
+// That file "includes" this one once per instruction set, each time inside
+// its own namespace and with VEC_WIDTH set to the number of doubles in one of
+// that instruction set's registers, so there is no include guard.  The choice
+// between the variants is made at run time (see VecLevel()).
+
+typedef double    VecD __attribute__ ((vector_size (8*VEC_WIDTH)));
+typedef long long VecL __attribute__ ((vector_size (8*VEC_WIDTH)));
+
+static inline VecD VecLoad (const double *x) {
+
+   VecD v;
+
+   memcpy (&v, x, sizeof (v));
+
+   return (v);
+
+}
+
+static inline void VecStore (double *x, VecD v) {
+
+   memcpy (x, &v, sizeof (v));
+
+}
+
+// Adding and subtracting 1.5 * 2^52 rounds |x| < 2^51 to the nearest integer,
+//    and leaves that integer in the low bits of the sum.  SSE2 and AVX2 have no
+//    double <-> 64-bit integer conversions, so the trick stands in for them.
+static const double VecMagic = 6755399441055744.0;
+
+static inline VecD VecRound (VecD x) {
+
+   return ((x + VecMagic) - VecMagic);
+
+}
+
+static inline VecL VecRoundToInt (VecD x) {
+
+   VecD zero = {};
+
+   return ((VecL) (x + VecMagic) - (VecL) (zero + VecMagic));
+
+}
+
+static inline VecD VecIntToDouble (VecL n) {
+
+   VecD zero = {};
+
+   return ((VecD) (n + (VecL) (zero + VecMagic)) - VecMagic);
+
+}
+
+// exp(x), from the Cephes library (S. L. Moshier).  Results below 2^-1022
+//    are flushed to zero.
+static inline VecD VecExp (VecD x) {
+
+   const double P0 = 1.26177193074810590878e-4,
+                P1 = 3.02994407707441961300e-2,
+                P2 = 9.99999999999999999910e-1,
+                Q0 = 3.00198505138664455042e-6,
+                Q1 = 2.52448340349684104192e-3,
+                Q2 = 2.27265548208155028766e-1,
+                Q3 = 2.00000000000000000009e0;
+   VecD z, px, xx, r, zero = {};
+   VecL n;
+
+   // Write x = n log(2) + z with |z| <= log(2)/2.
+   z = (x < -708.39) ? zero - 708.39 : x;
+   z = (z > 709.0) ? zero + 709.0 : z;
+   px = VecRound (z * 1.4426950408889634074);
+   n = VecRoundToInt (px);
+   z = z - px * 6.93145751953125e-1;
+   z = z - px * 1.42860682030941723212e-6;
+
+   // exp(z) = 1 + 2z P(z^2) / (Q(z^2) - z P(z^2)).
+   xx = z*z;
+   px = z * ((P0*xx + P1)*xx + P2);
+   r = px / ((((Q0*xx + Q1)*xx + Q2)*xx + Q3) - px);
+   r = 1.0 + 2.0*r;
+
+   // Multiply by 2^n by building the double directly.
+   r *= (VecD) ((n + 1023) << 52);
+
+   return ((x < -708.39) ? zero : r);
+
+}
+
+// log(x) for normal, positive x, from the Cephes library (S. L. Moshier).
+static inline VecD VecLog (VecD x) {
+
+   const double P0 = 1.01875663804580931796e-4,
+                P1 = 4.97494994976747001425e-1,
+                P2 = 4.70579119878881725854e0,
+                P3 = 1.44989225341610930846e1,
+                P4 = 1.79368678507819816313e1,
+                P5 = 7.70838733755885391666e0,
+                Q0 = 1.12873587189167450590e1,
+                Q1 = 4.52279145837532221105e1,
+                Q2 = 8.29875266912776603211e1,
+                Q3 = 7.11544750618563894466e1,
+                Q4 = 2.31251620126765340583e1;
+   VecL b, e, lo;
+   VecD m, z, y, ed;
+
+   // Split x = m 2^e with 1/2 <= m < 1.  (x > 0, so the shift is logical.)
+   b = (VecL) x;
+   e = ((b >> 52) & 0x7ff) - 1022;
+   m = (VecD) ((b & 0x000fffffffffffffLL) | 0x3fe0000000000000LL);
+
+   // Move m to sqrt(1/2) <= m < sqrt(2) and subtract 1.
+   lo = (m < 0.70710678118654752440);
+   e += lo;
+   m = lo ? m + m - 1.0 : m - 1.0;
+
+   // log(1+m) = m - m^2/2 + m^3 P(m)/Q(m).
+   z = m*m;
+   y = m * (z * (((((P0*m + P1)*m + P2)*m + P3)*m + P4)*m + P5)
+              / (((((m + Q0)*m + Q1)*m + Q2)*m + Q3)*m + Q4));
+   ed = VecIntToDouble (e);
+   y = y - ed * 2.121944400546905827679e-4;
+   y = y - 0.5*z;
+
+   return (m + y + ed * 0.693359375);
+
+}
+
+// cos(x) for |x| < 2^30, from the Cephes library (S. L. Moshier).  x is
+//    reduced to z in [-pi/4, pi/4] by a multiple j of pi/4 (even after
+//    rounding up), subtracted in three pieces so that z keeps its precision;
+//    then cos(x) is +-cos(z) or +-sin(z) according to j mod 8.
+static inline VecD VecCos (VecD x) {
+
+   const double S0 =  1.58962301576546568060e-10,
+                S1 = -2.50507477628578072866e-8,
+                S2 =  2.75573136213857245213e-6,
+                S3 = -1.98412698295895385996e-4,
+                S4 =  8.33333333332211858878e-3,
+                S5 = -1.66666666666666307295e-1,
+                C0 = -1.13585365213876817300e-11,
+                C1 =  2.08757008419747316778e-9,
+                C2 = -2.75573141792967388112e-7,
+                C3 =  2.48015872888517045348e-5,
+                C4 = -1.38888888888730564116e-3,
+                C5 =  4.16666666666665929218e-2;
+   VecD y, z, zz, s, c, zero = {};
+   VecL j, useSin, negate;
+
+   x = (x < 0) ? -x : x;
+
+   // j = floor(x 4/pi), rounded up to even.
+   j = VecRoundToInt (x * 1.27323954473516268615 - 0.5);
+   j += j & 1;
+   y = VecIntToDouble (j);
+   j &= 7;
+
+   z = ((x - y * 7.85398125648498535156e-1) - y * 3.77489470793079817668e-8)
+         - y * 2.69515142907905952645e-15;
+   zz = z*z;
+   s = z + z * zz * (((((S0*zz + S1)*zz + S2)*zz + S3)*zz + S4)*zz + S5);
+   c = 1.0 - 0.5*zz + zz * zz * (((((C0*zz + C1)*zz + C2)*zz + C3)*zz + C4)*zz + C5);
+
+   // j = 0: cos z, 2: -sin z, 4: -cos z, 6: sin z.
+   useSin = (j == 2) | (j == 6);
+   negate = (j == 2) | (j == 4);
+   y = useSin ? s : c;
+
+   return (negate ? zero - y : y);
+
+}
+
+// Nonzero if any lane of the mask m is set.
+static inline int VecAny (VecL m) {
+
+   long long any = 0;
+   int l;
+
+   for (l = 0; l < VEC_WIDTH; l++) {
+      any |= m[l];
+   }
+
+   return (any != 0);
+
+}
+
+static inline VecD VecSqrt (VecD x) {
+
+#if VEC_WIDTH == 8
+   // The zero-masking form, as _mm512_sqrt_pd() upsets GCC 12's warnings
+   return ((VecD) _mm512_maskz_sqrt_pd ((__mmask8) 0xFF, (__m512d) x));
+#elif VEC_WIDTH == 4
+   return ((VecD) _mm256_sqrt_pd ((__m256d) x));
+#elif defined(__SSE2__)
+   return ((VecD) _mm_sqrt_pd ((__m128d) x));
+#else
+   int l;
+
+   for (l = 0; l < VEC_WIDTH; l++) {
+      x[l] = sqrt (x[l]);
+   }
+
+   return (x);
+#endif
+
+}
+
+static inline VecD VecPsi (VecD x) {
+
+   const double A = 0.0293868870, B = 0.2161934875, C = 0.6503029656,
+                D = 0.7978845608, E = 0.0594864800, F = 0.4160822924;
+   VecD y, R, half;
+
+   y = (x < 0) ? -x : x;
+   R = (((A*y + B)*y + C)*y + D)*y / ((E*y + F)*y + 1);
+   half = 0.5 * (1.0 - VecExp (-R));
+
+   return ((x < 0) ? 0.5 - half : 0.5 + half);
+
+}
+
+static inline VecD VecPsiInv (VecD u) {
+
+   const double A1 = -3.969683028665376e+01, A2 =  2.209460984245205e+02,
+                A3 = -2.759285104469687e+02, A4 =  1.383577518672690e+02,
+                A5 = -3.066479806614716e+01, A6 =  2.506628277459239e+00,
+                B1 = -5.447609879822406e+01, B2 =  1.615858368580409e+02,
+                B3 = -1.556989798598866e+02, B4 =  6.680131188771972e+01,
+                B5 = -1.328068155288572e+01,
+                C1 = -7.784894002430293e-03, C2 = -3.223964580411365e-01,
+                C3 = -2.400758277161838e+00, C4 = -2.549732539343734e+00,
+                C5 =  4.374664141464968e+00, C6 =  2.938163982698783e+00,
+                D1 =  7.784695709041462e-03, D2 =  3.224671290700398e-01,
+                D3 =  2.445134137142996e+00, D4 =  3.754408661907416e+00,
+                P0 =  0.02425,
+                P1 =  0.97575;
+   VecD p, q, r, num, den, zero = {};
+   VecL tail;
+
+   // Middle, general case.
+   q = u - 0.5;
+   r = q*q;
+   num = (((((A1*r+A2)*r+A3)*r+A4)*r+A5)*r+A6)*q;
+   den = (((((B1*r+B2)*r+B3)*r+B4)*r+B5)*r+1);
+
+   // Tails, folded onto the left one: p = min(u, 1-u).  Only the numerator
+   //    and denominator are selected, so there is one division per lane.
+   tail = (u < P0) | (u > P1);
+   if (VecAny (tail)) {
+      p = (u < 0.5) ? u : 1.0 - u;
+      p = tail ? p : zero + P0;   // Keep log() well away from 0 in the middle.
+      q = VecSqrt (-2.0 * VecLog (p));
+      num = tail ? (((((C1*q+C2)*q+C3)*q+C4)*q+C5)*q+C6) : num;
+      q = ((((D1*q+D2)*q+D3)*q+D4)*q+1);
+      den = tail ? ((u < 0.5) ? q : -q) : den;
+   }
+
+   return (num / den);
+
+}
+
+static inline VecD VecPsiRA (VecD x) {
+
+   const double *a = PsiRA_a, *b = PsiRA_b, *c = PsiRA_c,
+                *d = PsiRA_d, *p = PsiRA_p, *q = PsiRA_q;
+   VecD y, xsq, ysq, xnum, xden, mid, tail, far, del, t, zero = {};
+   int i;
+
+   y = (x < 0) ? -x : x;
+
+   // Middle.
+   xsq = x*x;
+   xnum = a[4]*xsq;
+   xden = xsq;
+   for (i = 0; i < 3; i++) {
+      xnum = (xnum + a[i]) * xsq;
+      xden = (xden + b[i]) * xsq;
+   }
+   mid = 0.5 + x * (xnum + a[3]) / (xden + b[3]);
+   if (!VecAny ((x > 0.66291) | (x < -0.66291))) {
+      return (mid);
+   }
+
+   // Past y = 40 the tail underflows; clamping keeps the arithmetic finite.
+   y = (y > 40) ? zero + 40 : y;
+
+   // Moderate tails.
+   xnum = c[8]*y;
+   xden = y;
+   for (i = 0; i < 7; i++) {
+      xnum = (xnum + c[i]) * y;
+      xden = (xden + d[i]) * y;
+   }
+   tail = (xnum + c[7]) / (xden + d[7]);
+
+   // Far tails (y is kept away from 0 so that 1/y^2 stays finite).
+   if (VecAny (y > 5.65685424949238)) {
+      t = (y < 1.0) ? zero + 1.0 : y;
+      ysq = 1.0 / (t*t);
+      xnum = p[5]*ysq;
+      xden = ysq;
+      for (i = 0; i < 4; i++) {
+         xnum = (xnum + p[i]) * ysq;
+         xden = (xden + q[i]) * ysq;
+      }
+      far = ysq * (xnum + p[4]) / (xden + q[4]);
+      far = (0.398942280401432677939946059934 - far) / t;
+      tail = (y <= 5.65685424949238) ? tail : far;
+   }
+
+   // Scale the tail by exp(-y^2/2), split as in PsiRA().
+   t = VecRound (y * 16);
+   t = (t > y * 16) ? t - 1 : t;
+   xsq = t / 16;
+   del = (y - xsq) * (y + xsq);
+   tail *= VecExp (-xsq*xsq*0.5) * VecExp (-del*0.5);
+   tail = (x > 0) ? 1 - tail : tail;
+
+   return ((x <= 0.66291 && x >= -0.66291) ? mid : tail);
+
+}
+
+// Apply one of the kernels above to x[0], ..., x[n-1].  The last partial
+//    vector is padded with 1/2, which is a safe input for all of them.
+#define VEC_BATCH(KERNEL, x, y, n)                                  \
+   {                                                                \
+      double pad[VEC_WIDTH];                                        \
+      int i, k;                                                     \
+      for (i = 0; i + VEC_WIDTH <= n; i += VEC_WIDTH) {             \
+         VecStore (y+i, KERNEL (VecLoad (x+i)));                    \
+      }                                                             \
+      if (i < n) {                                                  \
+         for (k = 0; k < VEC_WIDTH; k++) pad[k] = 0.5;              \
+         for (k = 0; k < n-i; k++) pad[k] = x[i+k];                 \
+         VecStore (pad, KERNEL (VecLoad (pad)));                    \
+         for (k = 0; k < n-i; k++) y[i+k] = pad[k];                 \
+      }                                                             \
+   }
+
+void PsiBatch (const double *x, double *y, int n) {
+
+   VEC_BATCH (VecPsi, x, y, n);
+
+}
+
+void PsiInvBatch (const double *u, double *N, int n) {
+
+   VEC_BATCH (VecPsiInv, u, N, n);
+
+}
+
+// The batch counterpart of PsiTS() uses the rational approximations of PsiRA()
+//    rather than the Taylor series; it is at least as accurate.
+void PsiTSBatch (const double *x, double *y, int n) {
+
+   VEC_BATCH (VecPsiRA, x, y, n);
+
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Batch elementary functions, y[i] = f(x[i]) for i = 0, ..., n-1, with the
+// kernels above.  Largest errors found against long double over 10^7 points
+// each (libm's log and cos come within 0.52 ulp):
+//    LogBatch   x in (0, 1] and [1e-304, 1e304]      0.93 ulp
+//    ExpBatch   x in [-708, 709]                      1.7 ulp
+//    CosBatch   x in [-1e4, 1e4]                      1.6 ulp (absolute error
+//                                                     below 1.8e-16)
+// They take about 60% of the time of libm's log and 30% of its cos.
+// Simulation results may differ from those of the scalar functions in the
+// last digit, but not in distribution.  log(x) needs x positive and normal, exp()
+// underflows to 0 below -708.39, and cos() needs |x| < 2^30.
+void LogBatch (const double *x, double *y, int n) {
+
+   VEC_BATCH (VecLog, x, y, n);
+
+}
+
+void ExpBatch (const double *x, double *y, int n) {
+
+   VEC_BATCH (VecExp, x, y, n);
+
+}
+
+void CosBatch (const double *x, double *y, int n) {
+
+   VEC_BATCH (VecCos, x, y, n);
+
+}
+
+// Exponential variates with the given mean from the uniforms u[0], ..., u[n-1]
+//    (in (0,1]) by the inverse transform, t[i] = -mean log(u[i]).
+static inline VecD VecExponential (VecD u, double mean) {
+
+   return (VecLog (u) * -mean);
+
+}
+
+void ExponentialBatch (const double *u, double *t, int n, double mean) {
+
+#define VEC_EXPONENTIAL(u) VecExponential (u, mean)
+   VEC_BATCH (VEC_EXPONENTIAL, u, t, n);
+#undef VEC_EXPONENTIAL
+
+}
@@ -0,0 +1,109 @@
+// The library build of the dealership model; see RichMan.h for the interface. It is
+// built from the same function library and kernels as main.cpp, compiled with
+// -fvisibility=hidden so that only the RichMan functions are exported.
+#define RICHMAN_BUILD
+
+#include "4135FunctionDeclarations.h"
+#include "4135FunctionLibrary.h"
+#include "RichManKernels.h"
+#include "RichMan.h"
+
+struct RichManContext {
+    int years;
+    Matrix bank;            // A row per month and a column per year
+    double *profit;         // Each year's profit for the strategy being estimated
+    RichManStatistics statistics;
+};
+
+int RichManCreate(const RichManParams *params, RichManContext **context){
+    int years=(params!=NULL && params->years!=0) ? params->years : 100000;
+    unsigned int seed=(params!=NULL && params->seed!=0) ? params->seed : 1;
+    double sampleArrivals[12];
+    RichManContext *x;
+
+    if(context==NULL)
+        return (RICHMAN_EINVAL);
+    *context=NULL;
+    if(years<2)
+        return (RICHMAN_EINVAL);
+
+    // MatrixCreate() stops the program when out of memory, so the bank is made here
+    if((x=(RichManContext *) calloc(1, sizeof(RichManContext)))==NULL)
+        return (RICHMAN_ENOMEM);
+    x->years=years;
+    x->bank.rows=12;
+    x->bank.cols=years;
+    x->bank.stride=(years+7)&~7;
+    x->bank.block=malloc(12*(size_t) x->bank.stride*sizeof(double)+64);
+    x->profit=(double *) malloc(years*sizeof(double));
+    if(x->bank.block==NULL || x->profit==NULL){
+        free(x->bank.block);
+        free(x->profit);
+        free(x);
+        return (RICHMAN_ENOMEM);
+    }
+    x->bank.data=(double *) (((size_t) x->bank.block+63)&~(size_t) 63);
+    // The first touch puts the bank on the node of the calling thread, which on a NUMA
+    // machine should be the one that evaluates with the context
+    memset(x->bank.data, 0, 12*(size_t) x->bank.stride*sizeof(double));
+
+    for(int j=0; j<years; j++){
+        YearArrivalsAt(sampleArrivals, seed, j);
+        for(int m=0; m<12; m++)
+            MatrixRow(x->bank, m)[j]=sampleArrivals[m];
+    }
+
+    *context=x;
+    return (RICHMAN_OK);
+}
+
+int RichManEvaluate(RichManContext *context, const int *orders, int count, RichManEstimate *estimates){
+    if(context==NULL || count<0 || (count>0 && (orders==NULL || estimates==NULL)))
+        return (RICHMAN_EINVAL);
+    for(int k=0; k<12*count; k++)
+        if(orders[k]<0)
+            return (RICHMAN_EINVAL);
+
+    clock_t start=clock();
+    for(int k=0; k<count; k++){
+        double mean=0, m2=0;
+        PeriodProfitBatch<12>(context->bank, context->years, orders+12*k, context->profit);
+        for(int j=0; j<context->years; j++){
+            mean+=context->profit[j];
+            m2+=context->profit[j]*context->profit[j];
+        }
+        mean/=context->years;
+        m2/=context->years;
+        estimates[k].mean=mean;
+        estimates[k].halfWidth=1.96*sqrt((m2-mean*mean)/context->years);
+        estimates[k].years=context->years;
+    }
+    context->statistics.calls++;
+    context->statistics.strategies+=count;
+    context->statistics.seconds+=double(clock()-start)/CLOCKS_PER_SEC;
+    return (RICHMAN_OK);
+}
+
+int RichManGetStatistics(const RichManContext *context, RichManStatistics *statistics){
+    if(context==NULL || statistics==NULL)
+        return (RICHMAN_EINVAL);
+    *statistics=context->statistics;
+    return (RICHMAN_OK);
+}
+
+void RichManDestroy(RichManContext *context){
+    if(context==NULL)
+        return;
+    free(context->bank.block);
+    free(context->profit);
+    free(context);
+}
+
+const char *RichManError(int code){
+    switch(code){
+        case RICHMAN_OK:     return ("no error");
+        case RICHMAN_EINVAL: return ("invalid argument");
+        case RICHMAN_ENOMEM: return ("out of memory");
+    }
+    return ("unknown error");
+}
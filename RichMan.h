@@ -0,0 +1,78 @@
+// The dealership model as a library with a C interface, so that other programs can link
+// to it instead of running main.exe. A context holds a bank of simulated years, drawn
+// once when it is created; every strategy given to it is estimated from the same years
+// (common random numbers), so the estimates of a context depend only on its parameters.
+// There are no global variables: contexts are independent of each other, and a context
+// may be used by one thread at a time. Nothing is read from stdin or printed, and errors
+// are returned as the RICHMAN_ codes below.
+//
+//    RichManParams params={100000, 1};
+//    RichManContext *context;
+//    if(RichManCreate(&params, &context)==RICHMAN_OK){
+//        RichManEvaluate(context, orders, count, estimates);   // orders: count x 12
+//        RichManDestroy(context);
+//    }
+
+#ifndef RICHMAN_H
+#define RICHMAN_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#if defined(_WIN32) && defined(RICHMAN_BUILD)
+#define RICHMAN_API __declspec(dllexport)
+#elif defined(_WIN32)
+#define RICHMAN_API __declspec(dllimport)
+#else
+#define RICHMAN_API __attribute__ ((visibility ("default")))
+#endif
+
+typedef struct RichManContext RichManContext;
+
+// What a context is created with
+typedef struct {
+    int years;              // Simulated years per estimate, 0 for 100000
+    unsigned int seed;      // Which years, 0 for 1
+} RichManParams;
+
+// The estimated yearly profit of one strategy, in $K
+typedef struct {
+    double mean;
+    double halfWidth;       // Half-width of the 95% confidence interval
+    long long years;        // Years it was estimated from
+} RichManEstimate;
+
+// What a context has done so far
+typedef struct {
+    long long calls;        // Calls of RichManEvaluate()
+    long long strategies;   // Strategies estimated
+    double seconds;         // Processor time spent estimating them
+} RichManStatistics;
+
+enum {
+    RICHMAN_OK=0,
+    RICHMAN_EINVAL=-1,      // A NULL pointer, a negative count or order, or bad parameters
+    RICHMAN_ENOMEM=-2       // Out of memory
+};
+
+// Create a context; params may be NULL for the defaults
+RICHMAN_API int RichManCreate(const RichManParams *params, RichManContext **context);
+
+// Estimate count strategies, orders[12*k+m] cars for month m of strategy k, into
+// estimates[k]. Nothing is estimated if any order is negative.
+RICHMAN_API int RichManEvaluate(RichManContext *context, const int *orders, int count,
+                                RichManEstimate *estimates);
+
+RICHMAN_API int RichManGetStatistics(const RichManContext *context, RichManStatistics *statistics);
+
+RICHMAN_API void RichManDestroy(RichManContext *context);
+
+// A description of a RICHMAN_ code
+RICHMAN_API const char *RichManError(int code);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
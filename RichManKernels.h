@@ -0,0 +1,153 @@
+// The simulation kernels of the dealership model: a year's orders and the profit of an
+// order strategy for them. They keep no state of their own, so they are shared by
+// main.cpp and the library built from RichMan.cpp. This file must be "included" below
+// "4135FunctionLibrary.h".
+
+//////////////////////////////////////////////////////////////////////////////////////////
+// Kernels for a year of H periods: months (12), weeks (52) or days (365). The number of
+// periods is a template parameter, so every loop has a fixed trip count and each horizon
+// gets its own unrolled code. Holding a car costs $10K a year, 10/H per period.
+
+// The profit of ordering Orders[p] cars for period p when arrivals[p] orders arrive in it.
+// Cars not sold in a period are held over to the next, and those left at the end of the
+// year go at the clearance price. There are no branches: a period sells the smaller of
+// the stock and the orders.
+template<int H> double PeriodProfit(const double arrivals[], const int Orders[]){
+    const double costPer=150, sellFor=200, delivery=20, clearance=75, carryCost=10.0/H;
+    int n=0;
+    for(int c=0; c<H; c++)
+        n+=Orders[c];
+
+    double stock=0, revenue=0, netCost=costPer*n+delivery;
+#pragma GCC unroll 16
+    for(int i=0; i<H; i++){
+        stock+=Orders[i];
+        double sold=(stock<arrivals[i]) ? stock : arrivals[i];
+        revenue+=sellFor*sold;
+        stock-=sold;
+        netCost+=carryCost*stock;
+    }
+    revenue+=clearance*stock;
+
+    return (revenue-netCost);
+}
+
+// The same for many years at once, as many at a time as the vector type V holds: bank has
+// a row per period and a column per year, and profit[j] gets year j's profit.
+template<int H, typename V> static inline __attribute__ ((always_inline))
+void PeriodProfitLanes(Matrix bank, int years, const int Orders[], double profit[]){
+    const double costPer=150, sellFor=200, delivery=20, clearance=75, carryCost=10.0/H;
+    const int width=sizeof(V)/sizeof(double);
+    int n=0;
+    for(int c=0; c<H; c++)
+        n+=Orders[c];
+
+    for(int j=0; j<years; j+=width){
+        V stock={}, revenue={}, netCost={}, arrived;
+        netCost+=costPer*n+delivery;
+        for(int i=0; i<H; i++){
+            stock+=Orders[i];
+            memcpy(&arrived, MatrixRow(bank, i)+j, sizeof(V));
+            V sold=(stock<arrived) ? stock : arrived;
+            revenue+=sellFor*sold;
+            stock-=sold;
+            netCost+=carryCost*stock;
+        }
+        revenue+=clearance*stock;
+
+        V money=revenue-netCost;
+        for(int l=0; l<width && j+l<years; l++)
+            profit[j+l]=money[l];
+    }
+}
+
+#ifdef VEC_VARIANTS
+template<int H> __attribute__ ((target ("avx2")))
+void PeriodProfitAVX2(Matrix bank, int years, const int Orders[], double profit[]){
+    PeriodProfitLanes<H, VecAVX2::VecD>(bank, years, Orders, profit);
+}
+
+template<int H> __attribute__ ((target ("avx512f,avx512dq"), optimize ("fp-contract=off")))
+void PeriodProfitAVX512(Matrix bank, int years, const int Orders[], double profit[]){
+    PeriodProfitLanes<H, VecAVX512::VecD>(bank, years, Orders, profit);
+}
+#endif
+
+// PeriodProfitLanes() with the instruction set of the batch kernels (see VecLevel()); the
+// results are the same with each
+template<int H> void PeriodProfitBatch(Matrix bank, int years, const int Orders[], double profit[]){
+#ifdef VEC_VARIANTS
+    switch(VecLevel()){
+        case VEC_AVX512:
+            PeriodProfitAVX512<H>(bank, years, Orders, profit);
+            return;
+        case VEC_AVX2:
+            PeriodProfitAVX2<H>(bank, years, Orders, profit);
+            return;
+    }
+#endif
+    PeriodProfitLanes<H, VecD>(bank, years, Orders, profit);
+}
+
+// Count arrivals n gaps apart into the period they fall in, as AddArrivals() does into
+// months. Returns 1 when the year is over.
+template<int H> int PeriodArrivals(const double Tn[], int n, double *taou_n, double sampleArrivals[]){
+    for(int k=0; k<n; k++){
+        *taou_n+=Tn[k];
+        if(int(*taou_n/(1.0/H))<H)
+            sampleArrivals[int(*taou_n/(1.0/H))]++;
+        else
+            return (1);
+    }
+    return (0);
+}
+
+// Simulate a year's arrivals per period, with orders arriving at the given rate per year,
+// from the generator mt. Returns the number of orders in the year.
+template<int H> int PeriodYear(double sampleArrivals[], MTState *mt, double rate){
+    double Tn[8], U[8], taou_n=0, lambda=1.0/rate;
+    int n=0;
+
+    for(int c=0; c<H; c++)
+        sampleArrivals[c]=0;
+
+    do{
+        for(int k=0; k<8; k++)
+            U[k]=MTStateUniform(mt);
+        ExponentialBatch(U, Tn, 8, lambda);
+    }while(!PeriodArrivals<H>(Tn, 8, &taou_n, sampleArrivals));
+
+    for(int c=0; c<H; c++)
+        n+=int(sampleArrivals[c]);
+    return (n);
+}
+
+// A monthly strategy as a strategy of H periods: each month's cars come in the first
+// period that starts in that month.
+template<int H> void PeriodOrders(const int monthly[], int orders[]){
+    for(int p=0; p<H; p++)
+        orders[p]=(p==0 || (12*p)/H!=(12*(p-1))/H) ? monthly[(12*p)/H] : 0;
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////
+// Simulate the orders arriving in each month of year number rep of the years that seed
+// stands for. The uniforms come from the counter-based generator Philox(), with the seed
+// as key and (draw, rep) as the counter, so any year can be had directly without
+// simulating the ones before it.
+void YearArrivalsAt(double sampleArrivals[], unsigned int seed, unsigned int rep){
+    const unsigned int key[2]={seed, 0x4f524452};   // "ORDR"
+    unsigned int counter[4]={0, rep, 0, 0}, words[64];
+    double Tn[64], U[64], taou_n=0, lambda=1.0/50;
+
+    for(int c=0; c<12; c++)
+        sampleArrivals[c]=0;
+
+    // 64 words (16 counters) at a time; a year takes about 51
+    do{
+        PhiloxBatch(counter, key, words, 16);
+        counter[0]+=16;
+        for(int k=0; k<64; k++)
+            U[k]=WordUniform(words[k]);
+        ExponentialBatch(U, Tn, 64, lambda);
+    }while(!PeriodArrivals<12>(Tn, 64, &taou_n, sampleArrivals));
+}
@@ -1,91 +1,417 @@
 #include <iostream>
 #include <cstdlib>
 #include <cmath>
+#ifndef _WIN32
+#include <unistd.h>      // fork(), read(), write()
+#include <sys/socket.h>  // socketpair()
+#include <sys/wait.h>    // waitpid()
+#include <pthread.h>     // The result sink's writer thread
+#include <sys/un.h>      // The evaluation service's socket
+#include <signal.h>
+#include <errno.h>
+#include <sched.h>       // sched_yield()
+#include <sys/mman.h>    // mmap(), for memory placed on a NUMA node
+#include <sys/stat.h>    // lstat()
+#include <poll.h>        // The evaluation service's connections
+#endif
+#ifdef __linux__
+#include <sys/syscall.h>        // mbind(), get_mempolicy()
+#include <linux/mempolicy.h>
+#endif
 
 // Included functions anc C libraries.
 #include "4135FunctionDeclarations.h"
 
 using namespace std;
 
-// These functions are found below.
-double ProfitCalc(double[],int[]);
-double taou_n_tilda(int);
-double Profit(int[]);
+// Correlated demand across a chain of dealerships (see ChainDemandCreate()).
+typedef struct {
+    int locations;          // Number of dealerships N
+    int dim;                // 12*N, one coordinate per location and month
+    int block;              // Scenarios generated per call to ChainDemandBlock()
+    double *L;              // Cholesky factor of the correlation matrix
+    double *Z, *X;          // dim x block normals, before and after correlating
+    double cut[40];         // Normal quantiles of the monthly arrivals' distribution
+    ZigguratNormal g;
+} ChainDemand;
 
-// Global variables.
-int ordersForMonth_N[12];
-double orderArrival_N[2000];
+// A fleet of dealerships selling several models, as a structure of arrays (see
+// FleetCreate()). Arrays indexed by pair have stride entries; monthly arrays hold
+// month m of pair p at [m*stride+p].
+typedef struct {
+    int pairs;              // Number of location x product pairs
+    int stride;             // pairs rounded up to a whole number of vectors
+    int *location, *product;
+    double *rate;           // Expected sales per year
+    double *fixed;          // Cost of the cars ordered plus the delivery fee
+    double *orders;         // Cars delivered each month
+    double *arrivals;       // Orders arriving each month in the current scenario
+    int cuts;               // Entries per pair in cut[]
+    unsigned int *cut;      // Thresholds for turning 32-bit uniforms into arrivals
+    double *stock, *sold, *held, *profit;  // Current scenario
+    double *mean, *m2;      // Sample first and second moments of the profit
+    MTState mt;
+} Fleet;
 
-// These functions are found below.
-int main(){
-    // Seed the RNG.
-    MTUniform (1);
+// Statistics of one strategy's estimated profit, as accumulated by Profit()
+typedef struct {
+    double mean;            // Sample average profit (Pbarhat)
+    double m2;              // Sample average squared profit (P2barhat)
+    int reps;               // Number of simulated years
+} ProfitStats;
 
-    double bestProfit=0;       // Initiate best profit to 0
+// One estimated strategy, as logged by a ResultSink
+typedef struct {
+    int orders[12];
+    double mean;            // Estimated profit
+    double halfWidth;       // Half-width of its 95% confidence interval
+    long long reps;         // Years simulated
+    long long step;         // The search step that estimated it, counting from 0
+    double seconds;         // Wall time of that whole step
+} ResultRecord;
 
-    int bestOrders[]={0,0,0,0, // Array used to store and keep
-                      0,0,0,0, // track of best order
-                      0,0,0,0},
-        orders[]    ={0,0,0,0,   // Array used to test different
-                      0,0,0,0,   // order simulations and keep
-                      0,0,0,0};
+enum {RESULT_CSV, RESULT_JSONL, RESULT_BINARY};
 
-    double money=0;  // Stores the profit made by using the order details in orderForMonth_N
+// Logs ResultRecords to a file. Records are gathered in one buffer while a writer thread
+// formats and writes the other, so logging costs the search a copy per record.
+typedef struct {
+    FILE *fp;
+    int format;                         // RESULT_CSV, RESULT_JSONL or RESULT_BINARY
+    int capacity;                       // Records per buffer
+    ResultRecord *filling, *writing;    // The search's buffer and the writer's
+    int filled, toWrite;                // Records in each
+    int stop;                           // Set by ResultSinkClose()
+    long long records;
+    double addSeconds;                  // Time spent in ResultSinkAdd() and ResultSinkFlush()
+#ifndef _WIN32
+    pthread_t writer;
+    pthread_mutex_t lock;
+    pthread_cond_t ready, drained;      // The writer has work, has finished it
+#endif
+} ResultSink;
 
-    // Header showing the user the months that the order deliveries start and end
-    // also includes number of cars to order, the overall progress and the simulated
-    // expected profit
-    cout << "Jan " << "Feb " << "Mar " << "Apr " << "May "
-         << "Jun " << "Jul " << "Aug " << "Sep " << "Oct "
-         << "Nov " << "Dec " << "Cars " << "   Profit "
-         << " progress" << "\n";
+// The state of the order search in main(), so that it can be driven a step at a time
+typedef struct {
+    int numOfOrders, month;     // The next step to run
+    int ordersForMonth_N[12];   // The strategy the next step varies
+    int orders[12];             // Best number of cars found for each month
+    int bestOrders[12];         // Best strategy found
+    double bestProfit;          // Its estimated profit
+    MTState seeds;              // Source of each step's seed
+    long long evaluations;      // Strategies estimated so far
+    long long replications;     // Years simulated so far
+    double seconds;             // Time spent so far, over all runs
+    ResultSink *sink;           // Where every estimated strategy is logged, or NULL
+} Search;
 
-    clock_t start=clock(); // To calculate elapsed time
+// Something that estimates the profits of the count strategies in candidates[], all with
+// the given seed, into stats[] (see SearchStep())
+typedef void (*Evaluator)(int count, int candidates[][12], unsigned int seed,
+                          ProfitStats stats[], void *context);
 
-    // Loop that begins the simulation
-    for(int numOfOrders=5; numOfOrders<25; numOfOrders++){  // Range indicates the max number of car delivered in month p
-        for(int month=0; month<12; month++){ // p loops through all the months
-            double maxP=0;       // Store the best profit of the simulates strategies
+#ifndef _WIN32
+// The worker processes of a sharded search
+typedef struct {
+    int workers;
+    int *fd;                // Coordinator's end of each worker's socket pair
+    pid_t *pid;
+} Shards;
 
-            money=0; // Reset the expected amount to be made to zero for testing purposes
-            for(int orders_i=0; orders_i<numOfOrders; orders_i++){   // Loop through all the possibilities for each month
-                ordersForMonth_N[month]=orders_i; // Set the number of cars to be delivered in month i
-                money=Profit(ordersForMonth_N); // Calculate the profit for this strategy
+// A block of memory from NumaAlloc(), and the node it was asked for on
+typedef struct {
+    char *addr;
+    size_t bytes;
+    int node;
+} NumaBlock;
 
-                if(money>bestProfit){ // Test to see if this strategy is better then one already found
-                    bestProfit=money; // if true then store this as the profit for the best strategy
-                    maxP=money;       // also set it as the best profit for this set of simulations
-                    orders[month]=orders_i; // Store the specified delivery amount to keep track of the best strategy
-                }
-            }
+// The NUMA nodes that the threads of this process may run on, and the memory handed out
+// on them (see NumaStart())
+typedef struct {
+    int nodes;
+    int *id;                // The kernel's number for each node
+    int *first, *cpu;       // Node n has CPUs cpu[first[n]], ..., cpu[first[n+1]-1]
+    int fake;               // The nodes were made up by NUMA_FAKE
+    int bind;               // Memory can be bound to a node (real nodes, more than one)
+    pthread_mutex_t lock;   // Guards the blocks
+    int blocks, size;
+    NumaBlock *block;
+} Numa;
 
-            /*
-              Test new stategy to see if it is better then the
-              already found strategy (money indicates the profit
-              of the new strategy and best profit indicates the
-              best of all tested strategies)
-             */
+// A task of the work-stealing pool (see PoolEvaluator())
+typedef struct {
+    int candidate;          // The strategy to score, or -1 to simulate a block of years
+    int chunk;              // Which block of years
+    const double *years;    // That block, if candidate>=0
+} PoolTask;
 
-            if(money<bestProfit){
-                copy(orders, orders+12,
-                     bestOrders);
-            }
+// One worker's double-ended queue of tasks: the worker takes from the back, and idle
+// workers steal from the front
+typedef struct {
+    pthread_mutex_t lock;
+    PoolTask *task;
+    int head, count, size;  // A ring buffer of size tasks
+} PoolDeque;
 
-            // Make a copy of the array containing the
-            // simulations previous optimal outcome to
-            // test the next set of possibilities
-            copy(orders,orders+12,
-                 ordersForMonth_N);
-        }
+// A work-stealing pool of threads that evaluates the strategies of a search step
+typedef struct {
+    int threads;
+    pthread_t *thread;
+    PoolDeque *deque;       // One per thread
+    pthread_mutex_t lock;   // Guards everything below
+    pthread_cond_t work;    // Tasks were queued, or the pool is stopping
+    pthread_cond_t idle;    // A step's last task finished
+    int queued, outstanding, stop;
 
-        cout << " ";   int cars=0;  // Variable used to store the number of cars
-        for(int c=0; c<12; c++){
-            cout << bestOrders[c] << "   "; // Displays the best orders
-            cars+=bestOrders[c];            // Calculates the number of cars
-        }
-        // Display the optimal number of cars for the simulation, expected profit, and progress
-        cout << cars << "    "  << Profit(bestOrders) << "   " << numOfOrders+1-5 << "-"  << 20 << endl;
-    }
+    // The step being evaluated
+    int count, running;
+    int (*candidates)[12];
+    unsigned int seed;
+    ProfitStats *stats;
+    int *issued, *merged, *done, *ready;    // Chunks per candidate; ready[c*threads+slot]
+    double *profit;         // A block's profits per candidate and slot
+    double **years;         // Blocks of years simulated so far, NULL if not yet
+    int blocks, started;    // Entries in years[], blocks started
+
+    long long tasks, steals, discarded, spare;
+    Numa numa;              // Worker w is pinned with NumaPin(), and its years kept on its node
+} Pool;
+
+// The answer of the evaluation service for one strategy (see ServeMain())
+typedef struct {
+    double mean;            // Estimated profit
+    double halfWidth;       // Half-width of its 95% confidence interval
+    long long years;        // Years it was estimated from
+    int cached;             // 1 if it was answered from the cache
+    int valid;              // 0 if the strategy was rejected (negative orders)
+} ServiceAnswer;
+
+// A connection to the evaluation service, and the request it is part way through
+typedef struct {
+    int fd;
+    int got;                // Bytes of the request received so far
+    char *request;          // "RMEQ", the count, then the strategies
+} ServiceClient;
+
+// The evaluation service's cache of answers, an open-addressing hash table
+typedef struct {
+    int size, used;         // Slots, and slots taken; size is a power of 2
+    int (*orders)[12];
+    ServiceAnswer *answer;
+    char *taken;
+} ServiceCache;
+
+// One thread's share of the scoring in NumaMain()
+typedef struct {
+    Numa *numa;
+    int thread, node, cpu;
+    Matrix bank;            // The years it scores, a row per month
+    int (*candidates)[12];
+    int count;
+    double *sum;            // Its profits and squared profits of strategy c at [2*c], [2*c+1]
+    double seconds;
+    size_t local, remote;   // Bytes of the bank and strategies it read from its node, others
+} NumaShare;
+
+// A cell of the pipeline's ring: a block of simulated years on its way from a generator
+// thread to an evaluator (see PipelineMain())
+typedef struct {
+    unsigned long seq;      // Says whether the cell is waiting to be filled or taken
+    int block;              // Which block of years
+    double *years;          // The block, a row per month and a column per year
+} __attribute__ ((aligned (64))) PipeCell;
+
+// A bounded lock-free queue of blocks, any number of threads putting and taking
+typedef struct {
+    int size;               // Cells, a power of 2 and at least 2
+    PipeCell *cell;
+    unsigned long head __attribute__ ((aligned (64)));  // Next cell to take
+    unsigned long tail __attribute__ ((aligned (64)));  // Next cell to fill
+} PipeRing;
+
+struct Pipeline;
+
+// The counters of one pipeline thread, on a cache line of its own
+typedef struct {
+    struct Pipeline *pipe;
+    int thread, node, cpu;
+    double *spare;          // The block buffer the thread holds, on its node
+    long long blocks;       // Blocks simulated or scored
+    long long remote;       // Blocks scored from another node's ring
+    long long waits;        // Times the ring was full (generators) or empty (evaluators)
+    double busy, held;      // Seconds spent working, and waiting on the ring
+} __attribute__ ((aligned (64))) PipeStage;
+
+// Generator threads simulate blocks of years into the ring of their NUMA node and
+// evaluator threads score every strategy on each block they take from it
+typedef struct Pipeline {
+    Numa *numa;
+    PipeRing *ring;         // One per node
+    int generators, evaluators;
+    int blocks;             // Blocks of years to simulate
+    int next;               // The next block for a generator to simulate
+    int scored;             // Blocks scored so far
+    unsigned int seed;
+    int count;              // Strategies
+    int (*candidates)[12];
+    double *sum, *sum2;     // Profits and squared profits of block b and strategy c at [b*count+c]
+    PipeStage *stage;       // The generators', then the evaluators'
+} Pipeline;
+#endif
+
+enum {DEMAND_EMPIRICAL, DEMAND_FITTED, DEMAND_BOOTSTRAP};
+
+// Monthly orders learnt from historical sales, a stand-in for the Poisson arrivals of
+// YearArrivals() (see DemandCreate())
+typedef struct {
+    int years;              // Historical years
+    double *history;        // Orders in month m of historical year y at [y*12+m]
+    int mode;               // DEMAND_EMPIRICAL, DEMAND_FITTED or DEMAND_BOOTSTRAP
+    AliasTable month[12];   // Each month's orders, less low[m] (not when bootstrapping)
+    int low[12];
+    int block;              // Bootstrap: historical years taken one after the other
+    int next, left;         // Bootstrap: the next historical year, years left in its block
+    double *u;              // Uniforms for a batch of years
+    int *k;                 // Their draws from one month's table
+    MTState mt;
+} Demand;
+
+// These functions are found below.
+double ProfitCalc(double[],int[]);
+double taou_n_tilda(int);
+int    AddArrivals(const double[], int, double *, double[]);
+double Profit(int[], double[]=NULL);
+double ProfitCalcGrad(double[],int[],double[]);
+void   ProfitGradient(int[], MTState *, int, double *, double[]);
+void   SgdSearch(int[], int, int, int, unsigned int);
+int    SgdMain(int, char *[]);
+double SaaObjective(Matrix, int[], double, double);
+double SaaSolve(Matrix, int[], double, double, long long *);
+double ProfitCalcCarry(double[], int[], double, double, double *);
+int    RollingMain(int, char *[]);
+void   PolicyGrid(Matrix, int, int, int, const int[], const int[], double[], double[]);
+int    PolicyMain(int, char *[]);
+int    SaaMain(int, char *[]);
+void   ChainDemandCreate(ChainDemand *, int, double *, unsigned int);
+void   ChainDemandFree(ChainDemand *);
+void   ChainDemandBlock(ChainDemand *, double[]);
+double *ChainCorrelation(int, double, double);
+void   ChainProfit(ChainDemand *, int[], double[], double[], double[]);
+int    ChainMain(int, char *[]);
+int    FleetRead(Fleet *, const char *);
+void   FleetCreate(Fleet *, int, int[], int[], double[], double[]);
+void   FleetFree(Fleet *);
+void   FleetScenario(Fleet *);
+int    FleetProfit(Fleet *, double[]);
+int    FleetMain(int, char *[]);
+void   YearArrivals(double[], MTState *);
+int    YearArrivalsRate(double[], MTState *, double);
+int    TailMain(int, char *[]);
+double PhiloxUniform(unsigned int);
+int    RngMain(int, char *[]);
+void   YearArrivalsAt(double[], unsigned int, unsigned int);
+ProfitStats ProfitEstimate(int[], unsigned int);
+void   SearchStart(Search *, unsigned int);
+void   SearchStep(Search *, Evaluator, void *);
+void   OrderSearch(Search *, Evaluator, void *, const char *, double);
+int    SearchSave(const Search *, const char *);
+int    SearchLoad(Search *, const char *);
+int    CheckpointMain(int, char *[], int);
+double WallSeconds();
+void   LocalEvaluator(int, int[][12], unsigned int, ProfitStats[], void *);
+int    ShardMain(int, char *[]);
+#ifndef _WIN32
+void   PoolStart(Pool *, int);
+void   PoolSubmit(Pool *, int, int[][12], unsigned int, ProfitStats[]);
+void   PoolWait(Pool *);
+void   PoolStop(Pool *);
+void   PoolEvaluator(int, int[][12], unsigned int, ProfitStats[], void *);
+#endif
+int    PoolMain(int, char *[]);
+int    ServeMain(int, char *[]);
+int    QueryMain(int, char *[]);
+int    ResultSinkOpen(ResultSink *, const char *);
+void   ResultSinkAdd(ResultSink *, const ResultRecord[], int);
+void   ResultSinkFlush(ResultSink *);
+void   ResultSinkClose(ResultSink *);
+int    ResultsMain(int, char *[]);
+int    HorizonMain(int, char *[]);
+int    IsaMain(int, char *[]);
+int    DemandRead(double **, const char *);
+void   DemandCreate(Demand *, const double[], int, int, int, unsigned int);
+void   DemandFree(Demand *);
+void   DemandYears(Demand *, Matrix);
+void   DemandYear(Demand *, double[]);
+int    DemandMain(int, char *[]);
+int    PipelineMain(int, char *[]);
+#ifndef _WIN32
+void   NumaStart(Numa *);
+void   NumaStop(Numa *);
+int    NumaPin(Numa *, int, int *);
+void  *NumaAlloc(Numa *, size_t, int);
+void  *NumaMustAlloc(Numa *, size_t, int);
+void   NumaFree(Numa *, void *);
+int    NumaNodeOf(Numa *, const void *);
+#endif
+int    NumaMain(int, char *[]);
+
+// Global variables.
+double orderArrival_N[2000];
+double (*ProfitUniform)(unsigned int)=MTUniform;   // The generator Profit() draws from
+
+// These functions are found below.
+int main(int argc, char *argv[]){
+    // Other modes of the program are picked by the first argument.
+    if(argc>1 && !strcmp(argv[1], "chain"))
+        return ChainMain(argc-2, argv+2);
+    if(argc>1 && !strcmp(argv[1], "fleet"))
+        return FleetMain(argc-2, argv+2);
+    if(argc>1 && !strcmp(argv[1], "shard"))
+        return ShardMain(argc-2, argv+2);
+    if(argc>1 && !strcmp(argv[1], "sgd"))
+        return SgdMain(argc-2, argv+2);
+    if(argc>1 && !strcmp(argv[1], "saa"))
+        return SaaMain(argc-2, argv+2);
+    if(argc>1 && !strcmp(argv[1], "tail"))
+        return TailMain(argc-2, argv+2);
+    if(argc>1 && !strcmp(argv[1], "rng"))
+        return RngMain(argc-2, argv+2);
+    if(argc>1 && !strcmp(argv[1], "policy"))
+        return PolicyMain(argc-2, argv+2);
+    if(argc>1 && !strcmp(argv[1], "rolling"))
+        return RollingMain(argc-2, argv+2);
+    if(argc>1 && !strcmp(argv[1], "demand"))
+        return DemandMain(argc-2, argv+2);
+    if(argc>1 && !strcmp(argv[1], "isa"))
+        return IsaMain(argc-2, argv+2);
+    if(argc>1 && !strcmp(argv[1], "horizon"))
+        return HorizonMain(argc-2, argv+2);
+    if(argc>1 && !strcmp(argv[1], "serve"))
+        return ServeMain(argc-2, argv+2);
+    if(argc>1 && !strcmp(argv[1], "query"))
+        return QueryMain(argc-2, argv+2);
+    if(argc>1 && !strcmp(argv[1], "pipeline"))
+        return PipelineMain(argc-2, argv+2);
+    if(argc>1 && !strcmp(argv[1], "numa"))
+        return NumaMain(argc-2, argv+2);
+    if(argc>1 && !strcmp(argv[1], "pool"))
+        return PoolMain(argc-2, argv+2);
+    if(argc>1 && !strcmp(argv[1], "results"))
+        return ResultsMain(argc-2, argv+2);
+    if(argc>1 && !strcmp(argv[1], "checkpoint"))
+        return CheckpointMain(argc-2, argv+2, 0);
+    if(argc>1 && !strcmp(argv[1], "resume"))
+        return CheckpointMain(argc-2, argv+2, 1);
+
+    // Seed the RNG.
+    MTUniform (1);
+
+    Search search;   // Where the search is and the best strategy so far
+    SearchStart(&search, 1);
+
+    clock_t start=clock(); // To calculate elapsed time
+
+    // Run the whole search, evaluating every strategy in this process
+    OrderSearch(&search, LocalEvaluator, NULL, NULL, 0);
 
     cout<<"Computations took "<< double(clock()-start)/CLOCKS_PER_SEC<<
     " seconds.\n\n\t";
@@ -95,6 +421,7 @@ int main(){
 
 
 #include "4135FunctionLibrary.h"
+#include "RichManKernels.h"
 
 
 //////////////////////////////////////////////////////////////////////////////////////////
@@ -107,25 +434,55 @@ double taou_n_tilda(int n) {
     epsilon   =0.01,
     pi        =4*atan(-1);
 
-    while(!done){
-        i++;
-        double Tn, U, V, taou_n=orderArrival_N[n-1], lambda=1.0/90;
+    double Tn[8], U[8], V[8], taou_n[8], angle[8], cosine[8], lambda=1.0/90,
+    start=orderArrival_N[n-1],
+    startIntensity=1.0/90*(50-10*(double)cos(2*pi*start));
 
-        U=MTUniform(0); V=MTUniform(0);
-        while(1.0/90*(50-10*(double)cos(2*pi*taou_n))>=V){
-            U=MTUniform(0); V=MTUniform(0);
+    // The replications are independent, so eight run side by side, one per lane: in each
+    // round every lane draws its next candidate arrival, and their gaps and the seasonal
+    // intensity at each of them are computed in batch. A lane whose arrival is accepted
+    // records it and goes straight on to a new replication. The lanes take their random
+    // numbers in turn, so the estimate is not the one of running the replications one after
+    // another, though it has the same distribution.
+    for(int k=0; k<8; k++)
+        taou_n[k]=-1;   // Start a replication in every lane
 
-            Tn=-1*lambda*log(U);
-            taou_n+=Tn;
+    while(!done){
+        for(int k=0; k<8 && !done; k++){
+            // Starting a replication: it may be over at once, as in the loop test below
+            while(taou_n[k]<0 && !done){
+                U[k]=MTUniform(0); V[k]=MTUniform(0);
+                if(startIntensity>=V[k])
+                    taou_n[k]=start;
+                else{
+                    i++;
+                    Tbarhat =(Tbarhat*(i-1)+start)/i;
+                    T2barhat=(T2barhat*(i-1)+start*start)/i;
+                    if(i%5000==0 && 1.96*(sqrt((T2barhat-Tbarhat*Tbarhat)/i))<= epsilon)
+                        done=1;
+                }
+            }
+            U[k]=MTUniform(0); V[k]=MTUniform(0);
         }
+        if(done)
+            break;
 
-        Tbarhat =(Tbarhat*(i-1)+taou_n)/i;
-        T2barhat=(T2barhat*(i-1)+taou_n*taou_n)/i;
-
-        if(i%5000==0){
-            if (1.96*(sqrt((T2barhat-Tbarhat*Tbarhat)/i))<= epsilon)
-                done=1;
+        ExponentialBatch(U, Tn, 8, lambda);
+        for(int k=0; k<8; k++){
+            taou_n[k]+=Tn[k];
+            angle[k]=2*pi*taou_n[k];
         }
+        CosBatch(angle, cosine, 8);
+
+        for(int k=0; k<8 && !done; k++)
+            if(1.0/90*(50-10*cosine[k])<V[k]){
+                i++;
+                Tbarhat =(Tbarhat*(i-1)+taou_n[k])/i;
+                T2barhat=(T2barhat*(i-1)+taou_n[k]*taou_n[k])/i;
+                if(i%5000==0 && 1.96*(sqrt((T2barhat-Tbarhat*Tbarhat)/i))<= epsilon)
+                    done=1;
+                taou_n[k]=-1;
+            }
     }
 
     orderArrival_N[n]=Tbarhat;
@@ -135,8 +492,10 @@ double taou_n_tilda(int n) {
 
 //////////////////////////////////////////////////////////////////////////////////////////////
 // This function simulates a sample scenario for the order arrivals in a year and sends it to
-// the ProfitCalc to indicate the profit for the strategy specified in the array orders
-double Profit(int Orders[]){
+// the ProfitCalc to indicate the profit for the strategy specified in the array orders.
+// If grad is not NULL it also gets the estimated gradient of the expected profit, one
+// entry per month's order (see ProfitCalcGrad()), from the same simulated years.
+double Profit(int Orders[], double grad[]){
     // i counts the number of times the simulation was looped
     // done turns to 1 when the simulation is complete (telling
     // the program to break the loop)
@@ -145,7 +504,12 @@ double Profit(int Orders[]){
     double P2barhat  =0.000,   // Stores the sample avg second moment to test the variance
     Pbarhat   =0.000,       // Stores the sample avg to test variance and confidence
     epsilon   =5.000,       // Error tolerance
-    profit    =0.000;       // Profit for single simulation
+    profit    =0.000,       // Profit for single simulation
+    pathGrad[12];           // Gradient for single simulation
+
+    if(grad!=NULL)
+        for(int c=0; c<12; c++)
+            grad[c]=0;
 
     // Loops simulation till error tolerance is met
     while(!done){
@@ -158,37 +522,36 @@ double Profit(int Orders[]){
          lambda for the possion prosces
          sampleArrivals = simulated order arrivals
          */
-        double Tn, U, taou_n=0, lambda=1.0/50,
+        double Tn[8], U[8], taou_n=0, lambda=1.0/50,
         sampleArrivals[]={0,0,0,0,
                           0,0,0,0,
                           0,0,0,0};
 
         /*
          Loop until the nth arrival happens at t>=1 (corresponding
-         to the end of the year or the beginning of next)
+         to the end of the year or the beginning of next). The
+         times till the next arrivals are made eight at a time
+         from eight random numbers by the inverse transform. The
+         numbers left over when a year ends are dropped, so the
+         simulated years, and the strategies the search prints,
+         differ from those of drawing one number per arrival;
+         their distribution does not
          */
-        while(taou_n<1){
-            U=MTUniform(0); // Generate a random number from 0-1
-
-            Tn=-1*lambda*log(U); // Use the inverse transform to
-            // get the simulated time till
-            // the next arrival
-
-            taou_n+=Tn;          // Update the time till the nth arrival
-
-            // Check to see if a year has passed till the nth arrival.
-            // if it has break the loop. Otherwise add simulated order
-            // to the correct month
-            if(int(taou_n/(1.0/12))<12)
-                sampleArrivals[int(taou_n/(1.0/12))]++;
-            else
-                break;
-        }
+        do{
+            for(int k=0; k<8; k++)
+                U[k]=ProfitUniform(0); // Generate random numbers from 0-1
+            ExponentialBatch(U, Tn, 8, lambda);
+        }while(!AddArrivals(Tn, 8, &taou_n, sampleArrivals));
 
         // Calculate the profit for the sample arrivals and the
         // Orders specified at the begining of the orders
-        profit=ProfitCalc(sampleArrivals, Orders);
-
+        if(grad==NULL)
+            profit=ProfitCalc(sampleArrivals, Orders);
+        else{
+            profit=ProfitCalcGrad(sampleArrivals, Orders, pathGrad);
+            for(int c=0; c<12; c++)
+                grad[c]=(grad[c]*(i-1)+pathGrad[c])/i;
+        }
 
         Pbarhat =(Pbarhat*(i-1)+profit)/i;          // Update first sample moment
         P2barhat=(P2barhat*(i-1)+profit*profit)/i;  // Update second sample moment
@@ -210,65 +573,3943 @@ double Profit(int Orders[]){
 //This function calculates the profit of the strategy in the array Orders for the sample
 //scenario (in array arrivals) that was generated by the function profit
 double ProfitCalc(double arrivals[], int Orders[]){
-    // n is the number of cars specified in the current order
-    // the loop simply calculates n by adding all the orders
-    // specified for each month
-    int n=0;
-    for(int c=0; c<12; c++)
-        n+=Orders[c];
+    // The monthly case of PeriodProfit(). The cars not sold in a month are carried
+    // over to the next, and those left at the end of the year are sold at the
+    // clearance price ($75K); each car costs $150K, sells for $200K and costs $10K a
+    // year to hold, and there is a $20K yearly delivery fee.
+    return (PeriodProfit<12>(arrivals, Orders));
+}
 
-    double costPer  =150,      // Variable representing cost per car
-    sellFor  =200,      // Variable representing the selling price of each car
-    delivery =20 ,      // One time yearly delivery fee
-    clearance=75 ,      // Price of cars remaining on the lot (end of the year) are sold
-                        // at clearance ($75K)
-    carryCost=10.0/12;  // Cost of holding a car for a month ($10K per year)
+/////////////////////////////////////////////////////////////////////////////////////////
+// This function returns the same profit as ProfitCalc, and puts in grad[j] the change in
+// that profit when one more car is ordered for month j (a pathwise, or IPA, derivative).
+// The extra car is carried from month to month until a month in which more orders
+// arrive than there are cars on the lot, where it sells for sellFor; if it never sells
+// it goes at clearance. Since the arrivals and orders are whole numbers, the extra car
+// never crosses a kink of the profit, so grad[j] is exactly
+// ProfitCalc(Orders+e_j)-ProfitCalc(Orders) for this scenario.
+double ProfitCalcGrad(double arrivals[], int Orders[], double grad[]){
+    double costPer  =150,      // Same prices and costs as ProfitCalc
+    sellFor  =200,
+    delivery =20 ,
+    clearance=75 ,
+    carryCost=10.0/12;
 
-    double orders[13],         // Array used to store a duplicate of the specified orders
-    Revenue=0,          // Variable used to store simulated revenue
-    netCost=costPer*n+  // Variable used to store simulated cost
-    delivery;
+    double stock[12],          // Cars on the lot in each month
+    carry=0,            // Cars carried over from the month before
+    Revenue=0,
+    netCost=delivery;
+    int i;
 
+    // Forward through the year, as in ProfitCalc
+    for(i=0; i<12; i++){
+        stock[i]=Orders[i]+carry;
+        netCost+=costPer*Orders[i];
+        if(stock[i]>arrivals[i]){
+            Revenue+=sellFor*arrivals[i];
+            netCost+=carryCost*(stock[i]-arrivals[i]);
+            carry=stock[i]-arrivals[i];
+        }
+        else{
+            Revenue+=sellFor*stock[i];
+            carry=0;
+        }
+    }
+    Revenue+=clearance*carry;
 
-    /*
-     orders[12] is used to store cars carried over to next year
-     that will have to be sold at clearance prices
+    // Backward through the year: value is what one more car on the lot in month i earns
+    double value=clearance;
+    for(i=11; i>=0; i--){
+        if(stock[i]>=arrivals[i])
+            value-=carryCost;   // It is not sold this month
+        else
+            value=sellFor;      // It is sold this month
+        grad[i]=value-costPer;
+    }
 
-     orders is made to be a copy of Orders to make it easier to
-     store the leftover cars in slot 13 of orders (which will be sold
-     for $75K)
-     */
-    orders[12]=0;
-    copy(Orders,Orders+12,orders);
+    return(Revenue-netCost);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////
+// This function is ProfitCalc for a year that starts with stock cars already on the lot
+// (bought, and paid for, in an earlier year) and in which the cars left at the end are
+// worth salvage each: clearance if they are sold off, or nothing if they simply roll
+// into next year. The number left is put in *left if left is not NULL.
+double ProfitCalcCarry(double arrivals[], int Orders[], double stock, double salvage, double *left){
+    double costPer  =150,      // Same prices and costs as ProfitCalc
+    sellFor  =200,
+    delivery =20 ,
+    carryCost=10.0/12;
+
+    double carry=stock,        // Cars on the lot from the month before
+    Revenue=0,
+    netCost=delivery;
 
-    // Loop used to calculate total net profit and cost
     for(int i=0; i<12; i++){
-        // Check if there were more oders specified for month i
-        // then order arrival simulated for month i
-        if(orders[i]>arrivals[i]){
-            // If this is the case
-            // you make the money for the orders that arrived
+        double onLot=Orders[i]+carry;
+        netCost+=costPer*Orders[i];
+        if(onLot>arrivals[i]){
             Revenue+=sellFor*arrivals[i];
-            // You pay the carrying cost for the cars remaining on the lot
-            netCost+=carryCost*(orders[i]-arrivals[i]);
-            //add the cars that were unsolt to next months inventory
-            orders[i+1]+=orders[i]-arrivals[i];
+            netCost+=carryCost*(onLot-arrivals[i]);
+            carry=onLot-arrivals[i];
+        }
+        else{
+            Revenue+=sellFor*onLot;
+            carry=0;
+        }
+    }
+    Revenue+=salvage*carry;
+
+    if(left!=NULL)
+        *left=carry;
+    return(Revenue-netCost);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////
+// Correlated demand for a chain of dealerships. Month m at location l is coordinate
+// 12*l+m of a normal vector with the given 12N x 12N correlation matrix. Each
+// coordinate is turned into a Poisson(50/12) monthly count through its normal
+// quantile (a Gaussian copula), so every month on its own still looks like the arrivals in Profit(), but
+// locations and months move together as the matrix says.
+void ChainDemandCreate(ChainDemand *d, int N, double *corr, unsigned int seed){
+    d->locations=N;
+    d->dim=12*N;
+    d->block=250;
+
+    // Factor the correlation matrix once; the factor lives in corr from here on.
+    Cholesky(corr, d->dim);
+    d->L=corr;
+
+    d->Z=(double *) malloc((size_t)d->dim*d->block*sizeof(double));
+    d->X=(double *) malloc((size_t)d->dim*d->block*sizeof(double));
+
+    // A normal X maps to k arrivals when Psi(X) falls in the k-th step of the
+    // Poisson(50/12) distribution function, i.e. when cut[k-1] < X <= cut[k]
+    // with cut[k] = PsiInv(P(arrivals <= k)).  Comparing against the cuts saves
+    // evaluating Psi for every coordinate of every scenario.
+    double mean=50.0/12, p=exp(-mean), cdf[40];
+    cdf[0]=p;
+    for(int k=1; k<40; k++){
+        p*=mean/k;
+        cdf[k]=cdf[k-1]+p;
+        if(cdf[k]>1-1e-15)
+            cdf[k]=1-1e-15;
+    }
+    PsiInvBatch(cdf, d->cut, 40);
+
+    ZigguratSeed(&d->g, seed);
+}
+
+void ChainDemandFree(ChainDemand *d){
+    free(d->L);
+    free(d->Z);
+    free(d->X);
+}
+
+// Fill arrivals[(b*N+l)*12+m] with the arrivals in month m at location l for the
+// b-th of the next d->block scenarios
+void ChainDemandBlock(ChainDemand *d, double arrivals[]){
+    int n=d->dim*d->block;
+
+    // Independent normals, correlated all at once
+    ZigguratFill(&d->g, d->Z, n);
+    CholeskyMultiply(d->L, d->dim, d->Z, d->X, d->block);
+
+    // Map to arrivals (the mean is about 4, so the search is short) and
+    // transpose to one scenario after another
+    for(int r=0; r<d->dim; r++){
+        for(int b=0; b<d->block; b++){
+            double X=d->X[r*d->block+b];
+            int k=0;
+            while(k<39 && X>d->cut[k])
+                k++;
+            arrivals[b*d->dim+r]=k;
+        }
+    }
+}
+
+// The correlation matrix for N locations in which the same month at two locations
+// has correlation rhoLoc and months i and j at one location have correlation
+// rhoMonth^|i-j|, i.e. the Kronecker product of the two.
+double *ChainCorrelation(int N, double rhoLoc, double rhoMonth){
+    int dim=12*N;
+    double *R=(double *) malloc((size_t)dim*dim*sizeof(double));
+
+    for(int r=0; r<dim; r++)
+        for(int c=0; c<dim; c++)
+            R[r*dim+c]=(r/12==c/12 ? 1 : rhoLoc)*pow(rhoMonth, abs(r%12-c%12));
+
+    return (R);
+}
+
+// Estimate the expected profit of each location in the chain when they all follow
+// the strategy in Orders. Like Profit(), scenarios are added until every location's
+// 95% confidence half-width is within epsilon. The chain total and its half-width
+// are returned in total[0] and total[1].
+void ChainProfit(ChainDemand *d, int Orders[], double mean[], double half[], double total[]){
+    int N=d->locations, i=0, done=0;
+    Arena *scratch=ThreadArena();
+    size_t mark=ArenaMark(scratch);
+    double epsilon=5.000,
+    *arrivals=(double *) ArenaAlloc(scratch, (size_t)d->dim*d->block*sizeof(double)),
+    *P2barhat=(double *) ArenaAlloc(scratch, N*sizeof(double)),
+    T2barhat=0;
+
+    for(int l=0; l<N; l++)
+        mean[l]=P2barhat[l]=0;
+    total[0]=0;
+
+    while(!done){
+        ChainDemandBlock(d, arrivals);
+
+        for(int b=0; b<d->block; b++){
+            double chain=0;
+            i++;
+            for(int l=0; l<N; l++){
+                double profit=ProfitCalc(arrivals+b*d->dim+12*l, Orders);
+                mean[l]    =(mean[l]*(i-1)+profit)/i;
+                P2barhat[l]=(P2barhat[l]*(i-1)+profit*profit)/i;
+                chain+=profit;
+            }
+            total[0]=(total[0]*(i-1)+chain)/i;
+            T2barhat=(T2barhat*(i-1)+chain*chain)/i;
+        }
+
+        // Check the error tolerance every 1000 scenarios, as Profit() does
+        if(i%1000==0){
+            done=1;
+            for(int l=0; l<N; l++){
+                half[l]=1.96*sqrt((P2barhat[l]-mean[l]*mean[l])/i);
+                if(half[l]>epsilon)
+                    done=0;
+            }
+        }
+    }
+    total[1]=1.96*sqrt((T2barhat-total[0]*total[0])/i);
+
+    ArenaRelease(scratch, mark);
+}
+
+// chain N rhoLoc rhoMonth [12 orders]   or   chain N matrixFile [12 orders]
+// Evaluates one ordering strategy (by default 4 cars a month) at every location of a
+// chain of N dealerships whose monthly demands are correlated.
+int ChainMain(int argc, char *argv[]){
+    int N, Orders[12]={4,4,4,4,4,4,4,4,4,4,4,4}, first;
+    double *corr;
+
+    if(argc<2 || (N=atoi(argv[0]))<1){
+        cout << "usage: chain N rhoLoc rhoMonth [orders]  or  chain N matrixFile [orders]\n";
+        return (1);
+    }
+
+    // Either read the whole 12N x 12N matrix or build it from the two correlations
+    FILE *fp=fopen(argv[1], "r");
+    if(fp!=NULL){
+        corr=(double *) malloc((size_t)144*N*N*sizeof(double));
+        for(int k=0; k<144*N*N; k++){
+            if(fscanf(fp, "%lf", corr+k)!=1){
+                cout << "The correlation matrix in " << argv[1] << " is too short.\n";
+                fclose(fp);
+                free(corr);
+                return (1);
+            }
+        }
+        fclose(fp);
+        first=2;
+    }
+    else if(argc>=3){
+        corr=ChainCorrelation(N, atof(argv[1]), atof(argv[2]));
+        first=3;
+    }
+    else{
+        cout << "Cannot read " << argv[1] << ".\n";
+        return (1);
+    }
+
+    for(int c=0; c<12 && first+c<argc; c++)
+        Orders[c]=atoi(argv[first+c]);
+
+    ChainDemand d;
+    double *mean=(double *) malloc(N*sizeof(double)),
+           *half=(double *) malloc(N*sizeof(double)), total[2];
+
+    clock_t start=clock();
+    ChainDemandCreate(&d, N, corr, 1);
+    ChainProfit(&d, Orders, mean, half, total);
+
+    cout << "Location    Profit   +/-\n";
+    for(int l=0; l<N; l++)
+        printf("%8d %9.2f %5.2f\n", l+1, mean[l], half[l]);
+    printf("   Chain %9.2f %5.2f\n", total[0], total[1]);
+    cout << "Computations took " << double(clock()-start)/CLOCKS_PER_SEC << " seconds.\n";
+
+    ChainDemandFree(&d);
+    free(mean);
+    free(half);
+    return (0);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////
+// Fleet simulation: every location x product pair of the fleet is one dealership as in
+// ProfitCalc(), with its own yearly sales rate and 12-month plan. The state of the
+// whole fleet is kept as a structure of arrays -- one array per quantity, indexed by
+// pair, with the monthly arrays laid out month by month -- so that one scenario for
+// the whole fleet is a handful of passes over contiguous memory that run in vector
+// registers. In each scenario every pair draws its own arrivals, independent of the
+// other pairs', from the fleet's one generator.
+
+// Read the fleet plan from a CSV file with lines "location,product,rate,o1,...,o12".
+// Lines that do not start with a number (a header, say) are skipped. Returns the
+// number of pairs read, or 0 if the file cannot be read.
+int FleetRead(Fleet *f, const char *fileName){
+    FILE *fp=fopen(fileName, "r");
+    char line[1024];
+    int n=0, size=64;
+
+    if(fp==NULL)
+        return (0);
+
+    int *location=(int *) malloc(size*sizeof(int)), *product=(int *) malloc(size*sizeof(int));
+    double *rate=(double *) malloc(size*sizeof(double)), *plan=(double *) malloc(size*12*sizeof(double));
+
+    while(fgets(line, sizeof(line), fp)!=NULL){
+        int o[12];
+        if(sscanf(line, "%d,%d,%lf,%d,%d,%d,%d,%d,%d,%d,%d,%d,%d,%d,%d",
+                  location+n, product+n, rate+n, o, o+1, o+2, o+3, o+4, o+5,
+                  o+6, o+7, o+8, o+9, o+10, o+11)!=15)
+            continue;
+        for(int m=0; m<12; m++)
+            plan[n*12+m]=o[m];
+        if(++n==size){
+            size*=2;
+            location=(int *) realloc(location, size*sizeof(int));
+            product =(int *) realloc(product, size*sizeof(int));
+            rate    =(double *) realloc(rate, size*sizeof(double));
+            plan    =(double *) realloc(plan, size*12*sizeof(double));
+        }
+    }
+    fclose(fp);
+
+    if(n>0)
+        FleetCreate(f, n, location, product, rate, plan);
+    free(location); free(product); free(rate); free(plan);
+    return (n);
+}
+
+// Set up a fleet of n pairs. plan[12*p+m] is the number of cars delivered to pair p in
+// month m.
+void FleetCreate(Fleet *f, int n, int location[], int product[], double rate[], double plan[]){
+    // Pad the pairs to a whole number of vectors; padding pairs sell nothing
+    int stride=(n+VEC_WIDTH-1)/VEC_WIDTH*VEC_WIDTH;
+
+    f->pairs=n;
+    f->stride=stride;
+    f->location=(int *) calloc(stride, sizeof(int));
+    f->product =(int *) calloc(stride, sizeof(int));
+    f->rate    =(double *) calloc(stride, sizeof(double));
+    f->fixed   =(double *) calloc(stride, sizeof(double));
+    f->orders  =(double *) calloc(12*stride, sizeof(double));
+    f->arrivals=(double *) calloc(12*stride, sizeof(double));
+    f->stock   =(double *) calloc(stride, sizeof(double));
+    f->sold    =(double *) calloc(stride, sizeof(double));
+    f->held    =(double *) calloc(stride, sizeof(double));
+    f->profit  =(double *) calloc(stride, sizeof(double));
+    f->mean    =(double *) calloc(stride, sizeof(double));
+    f->m2      =(double *) calloc(stride, sizeof(double));
+
+    // Enough cuts that a monthly count beyond the last has probability < 1e-15
+    double most=0;
+    for(int p=0; p<n; p++)
+        if(rate[p]>most)
+            most=rate[p];
+    f->cuts=int(most/12+10*sqrt(most/12)+20);
+    f->cut=(unsigned int *) malloc((size_t)stride*f->cuts*sizeof(unsigned int));
+
+    for(int p=0; p<stride; p++){
+        double mean=(p<n) ? rate[p]/12 : 0, P=exp(-mean), cdf=P;
+        int total=0;
+
+        if(p<n){
+            f->location[p]=location[p];
+            f->product[p]=product[p];
+            f->rate[p]=rate[p];
+            for(int m=0; m<12; m++){
+                f->orders[m*stride+p]=plan[12*p+m];
+                total+=int(plan[12*p+m]);
+            }
+        }
+        // Same costs as ProfitCalc(): $150K a car plus the $20K delivery fee
+        f->fixed[p]=150.0*total+20;
+
+        // Monthly arrivals are Poisson(rate/12); a 32-bit uniform N gives k arrivals
+        // when cut[k-1] < N <= cut[k], with cut[k] = 2^32 P(arrivals <= k).
+        for(int k=0; k<f->cuts; k++){
+            f->cut[(size_t)p*f->cuts+k]=(cdf>=1 || k==f->cuts-1) ? 0xffffffff : (unsigned int)(cdf*4294967296.0);
+            P*=mean/(k+1);
+            cdf+=P;
+        }
+    }
+
+    MTSeed(&f->mt, 1);
+}
+
+void FleetFree(Fleet *f){
+    free(f->location); free(f->product); free(f->rate); free(f->fixed);
+    free(f->orders); free(f->arrivals); free(f->cut);
+    free(f->stock); free(f->sold); free(f->held); free(f->profit);
+    free(f->mean); free(f->m2);
+}
+
+// Generate one scenario of monthly arrivals for every pair and compute every pair's
+// profit for it into f->profit[]. This is ProfitCalc() for all pairs at once.
+void FleetScenario(Fleet *f){
+    int n=f->stride;
+    const double sellFor=200, clearance=75, carryCost=10.0/12;
+
+    for(int m=0; m<12; m++){
+        double *a=f->arrivals+m*n;
+        for(int p=0; p<f->pairs; p++){
+            const unsigned int *cut=f->cut+(size_t)p*f->cuts;
+            unsigned int N=MTNext(&f->mt);
+            int k=0;
+            while(N>cut[k])
+                k++;
+            a[p]=k;
+        }
+    }
+
+    for(int p=0; p<n; p+=VEC_WIDTH){
+        VecD stock={}, sold={}, held={};
+        for(int m=0; m<12; m++){
+            // Cars on the lot are sold up to the number of orders that arrived and
+            // the rest are carried into next month
+            VecD avail=stock+VecLoad(f->orders+m*n+p), arrived=VecLoad(f->arrivals+m*n+p);
+            VecD sale=(avail<arrived) ? avail : arrived;
+            sold+=sale;
+            stock=avail-sale;
+            held+=stock;
+        }
+        // Leftover cars go at the clearance price
+        VecStore(f->profit+p, sellFor*sold+clearance*stock-carryCost*held-VecLoad(f->fixed+p));
+    }
+}
+
+// Estimate the expected profit of every pair, adding scenarios until every pair's 95%
+// confidence half-width is within epsilon, as in Profit(). Returns the number of
+// scenarios; the fleet total and its half-width are put in total[0] and total[1].
+int FleetProfit(Fleet *f, double total[]){
+    int i=0, done=0;
+    double epsilon=5.000, T2barhat=0;
+
+    for(int p=0; p<f->stride; p++)
+        f->mean[p]=f->m2[p]=0;
+    total[0]=0;
+
+    while(!done){
+        i++;
+        FleetScenario(f);
+
+        double fleet=0;
+        for(int p=0; p<f->pairs; p++){
+            double profit=f->profit[p];
+            f->mean[p]=(f->mean[p]*(i-1)+profit)/i;
+            f->m2[p]  =(f->m2[p]*(i-1)+profit*profit)/i;
+            fleet+=profit;
+        }
+        total[0]=(total[0]*(i-1)+fleet)/i;
+        T2barhat=(T2barhat*(i-1)+fleet*fleet)/i;
+
+        if(i%1000==0){
+            done=1;
+            for(int p=0; p<f->pairs && done; p++)
+                if(1.96*sqrt((f->m2[p]-f->mean[p]*f->mean[p])/i)>epsilon)
+                    done=0;
+        }
+    }
+    total[1]=1.96*sqrt((T2barhat-total[0]*total[0])/i);
+
+    return (i);
+}
+
+// fleet planFile [resultFile]   or   fleet L P
+// Evaluates the order plans of a whole fleet in one run. The plan file has one line
+// "location,product,rate,o1,...,o12" per pair; results for every pair can be written
+// to a CSV file. Without a plan file, a made-up fleet of L locations selling P models
+// each is evaluated, every pair ordering about its expected monthly sales.
+int FleetMain(int argc, char *argv[]){
+    Fleet f;
+
+    if(argc<1){
+        cout << "usage: fleet planFile [resultFile]  or  fleet L P\n";
+        return (1);
+    }
+    FILE *fp=NULL;
+
+    if(FleetRead(&f, argv[0])==0){
+        int L=atoi(argv[0]), P=(argc>1) ? atoi(argv[1]) : 1, n=L*P;
+        if(L<1 || P<1){
+            cout << "Cannot read a fleet plan from " << argv[0] << ".\n";
+            return (1);
+        }
+        int *location=(int *) malloc(n*sizeof(int)), *product=(int *) malloc(n*sizeof(int));
+        double *rate=(double *) malloc(n*sizeof(double)), *plan=(double *) malloc(n*12*sizeof(double));
+        for(int p=0; p<n; p++){
+            location[p]=p/P+1;
+            product[p]=p%P+1;
+            rate[p]=50*(0.5+(p/P)%11/10.0)/P;  // Locations of different sizes
+            for(int m=0; m<12; m++)
+                plan[12*p+m]=floor(rate[p]/12+0.5);
+        }
+        FleetCreate(&f, n, location, product, rate, plan);
+        free(location); free(product); free(rate); free(plan);
+    }
+    else if(argc>1 && (fp=fopen(argv[1], "w"))==NULL){
+        cout << "Cannot create " << argv[1] << ".\n";
+        cout << "usage: fleet planFile [resultFile]  or  fleet L P\n";
+        FleetFree(&f);
+        return (1);
+    }
+
+    clock_t start=clock();
+    double total[2];
+    int i=FleetProfit(&f, total);
+
+    cout << f.pairs << " location x product pairs, " << i << " scenarios\n";
+    printf("Fleet profit %12.2f +/- %.2f\n", total[0], total[1]);
+    cout << "Computations took " << double(clock()-start)/CLOCKS_PER_SEC << " seconds.\n";
+
+    if(fp!=NULL){
+        fprintf(fp, "location,product,rate,profit,halfwidth\n");
+        for(int p=0; p<f.pairs; p++)
+            fprintf(fp, "%d,%d,%g,%.2f,%.2f\n", f.location[p], f.product[p], f.rate[p], f.mean[p],
+                    1.96*sqrt((f.m2[p]-f.mean[p]*f.mean[p])/i));
+        fclose(fp);
+    }
+
+    FleetFree(&f);
+    return (0);
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////
+// This function simulates the order arrivals for one year, as in Profit(), but draws its
+// random numbers from the generator mt rather than from MTUniform
+void YearArrivals(double sampleArrivals[], MTState *mt){
+    YearArrivalsRate(sampleArrivals, mt, 50);
+}
+
+// The same with orders arriving at the given rate per year instead of 50. Returns the
+// number of orders in the year.
+int YearArrivalsRate(double sampleArrivals[], MTState *mt, double rate){
+    return (PeriodYear<12>(sampleArrivals, mt, rate));
+}
+
+// Add arrivals after the gaps Tn[0], ..., Tn[n-1] to the months they fall in, carrying
+// on from the time taou_n. Returns 1 once an arrival falls past the end of the year
+// (the rest of the gaps are then not needed), and 0 if the year is not over yet.
+int AddArrivals(const double Tn[], int n, double *taou_n, double sampleArrivals[]){
+    return (PeriodArrivals<12>(Tn, n, taou_n, sampleArrivals));
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////
+// This function estimates the expected profit of the strategy in Orders exactly like
+// Profit(), except that simulated year number r is YearArrivalsAt(seed, r). The estimate
+// is then a function of the strategy and the seed alone, so it comes out the same
+// whichever process (or thread) computes it and in whatever order, and strategies
+// estimated with the same seed see the same years (common random numbers).
+ProfitStats ProfitEstimate(int Orders[], unsigned int seed){
+    ProfitStats stats={0,0,0};
+    int done=0;
+    double epsilon=5.000, sampleArrivals[12];
+
+    // Loops simulation till error tolerance is met
+    while(!done){
+        YearArrivalsAt(sampleArrivals, seed, stats.reps);
+        stats.reps++;
+
+        double profit=ProfitCalc(sampleArrivals, Orders);
+        stats.mean=(stats.mean*(stats.reps-1)+profit)/stats.reps;
+        stats.m2  =(stats.m2*(stats.reps-1)+profit*profit)/stats.reps;
+
+        if(stats.reps%1000==0)
+            if(1.96*sqrt((stats.m2-stats.mean*stats.mean)/stats.reps)<=epsilon)
+                done=1;
+    }
+
+    return (stats);
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////
+// The order search that main() runs. For numOfOrders=5,...,24 it sweeps the months, and
+// for each month tries every number of cars below numOfOrders with the other months held
+// at the best strategy found so far. The strategies tried for one month (one "step")
+// are independent of each other, so a step is handed to an evaluator as a batch; all the
+// strategies in a step share one seed (common random numbers), drawn from search->seeds.
+
+// Start a search from no orders at all; seed decides every step's seed
+void SearchStart(Search *search, unsigned int seed){
+    search->numOfOrders=5;
+    search->month=0;
+    search->bestProfit=0;
+    search->evaluations=search->replications=0;
+    search->seconds=0;
+    search->sink=NULL;
+    for(int c=0; c<12; c++)
+        search->orders[c]=search->bestOrders[c]=search->ordersForMonth_N[c]=0;
+    MTSeed(&search->seeds, seed);
+}
+
+// Evaluator that estimates the strategies of a step in this process. Since they share the
+// seed, they are all estimated from the same years, so a block of years is simulated
+// once into a scenario matrix and every strategy still running is scored on all of it
+// (a strategy x year profit matrix) before the statistics are brought up to date. The
+// results are those of ProfitEstimate() for each strategy in turn.
+void LocalEvaluator(int count, int candidates[][12], unsigned int seed, ProfitStats stats[], void *context){
+    const int block=1000;   // Years per block, also how often the tolerance is checked
+    const double epsilon=5.000;
+    Arena *scratch=ThreadArena();
+    size_t mark=ArenaMark(scratch);
+    Matrix years=MatrixCreate(block, 12, scratch), profits=MatrixCreate(count, block, scratch);
+    int *done=(int *) ArenaAlloc(scratch, count*sizeof(int)), running=count;
+    unsigned int simulated=0;
+
+    for(int k=0; k<count; k++){
+        stats[k].mean=stats[k].m2=stats[k].reps=0;
+        done[k]=0;
+    }
+
+    while(running>0){
+        for(int r=0; r<block; r++)
+            YearArrivalsAt(MatrixRow(years, r), seed, simulated++);
+
+        for(int k=0; k<count; k++){
+            if(done[k])
+                continue;
+            double *profit=MatrixRow(profits, k);
+            for(int r=0; r<block; r++)
+                profit[r]=ProfitCalc(MatrixRow(years, r), candidates[k]);
+        }
+
+        for(int k=0; k<count; k++){
+            if(done[k])
+                continue;
+            ProfitStats *st=&stats[k];
+            double *profit=MatrixRow(profits, k);
+            for(int r=0; r<block; r++){
+                st->reps++;
+                st->mean=(st->mean*(st->reps-1)+profit[r])/st->reps;
+                st->m2  =(st->m2*(st->reps-1)+profit[r]*profit[r])/st->reps;
+            }
+            if(1.96*sqrt((st->m2-st->mean*st->mean)/st->reps)<=epsilon){
+                done[k]=1;
+                running--;
+            }
+        }
+    }
+
+    ArenaRelease(scratch, mark);
+}
+
+// Run one step of the search, i.e. one pass of the innermost loop of the original main()
+void SearchStep(Search *search, Evaluator evaluate, void *context){
+    int month=search->month, numOfOrders=search->numOfOrders;
+    Arena *scratch=ThreadArena();
+    size_t mark=ArenaMark(scratch);
+    int (*candidates)[12]=(int (*)[12]) ArenaAlloc(scratch, numOfOrders*sizeof(*candidates));
+    ProfitStats *stats=(ProfitStats *) ArenaAlloc(scratch, numOfOrders*sizeof(ProfitStats));
+    unsigned int seed=MTNext(&search->seeds);
+
+    // The strategies to try: the current one with month set to 0,...,numOfOrders-1 cars
+    for(int orders_i=0; orders_i<numOfOrders; orders_i++){
+        copy(search->ordersForMonth_N, search->ordersForMonth_N+12, candidates[orders_i]);
+        candidates[orders_i][month]=orders_i;
+    }
+    double started=(search->sink!=NULL) ? WallSeconds() : 0;
+    evaluate(numOfOrders, candidates, seed ? seed : 1, stats, context);
+    if(search->sink!=NULL){
+        ResultRecord *log=(ResultRecord *) ArenaAlloc(scratch, numOfOrders*sizeof(ResultRecord));
+        double seconds=WallSeconds()-started;
+        long long step=(search->numOfOrders-5)*12+month;
+        for(int k=0; k<numOfOrders; k++){
+            ProfitStats *st=&stats[k];
+            copy(candidates[k], candidates[k]+12, log[k].orders);
+            log[k].mean=st->mean;
+            log[k].halfWidth=1.96*sqrt((st->m2-st->mean*st->mean)/st->reps);
+            log[k].reps=st->reps;
+            log[k].step=step;
+            log[k].seconds=seconds;
         }
+        ResultSinkAdd(search->sink, log, numOfOrders);
+        ResultSinkFlush(search->sink);
+    }
+    search->evaluations+=numOfOrders;
+    for(int orders_i=0; orders_i<numOfOrders; orders_i++)
+        search->replications+=stats[orders_i].reps;
+
+    double money=0;  // Stores the profit made by the strategy being looked at
+    for(int orders_i=0; orders_i<numOfOrders; orders_i++){   // Loop through all the possibilities for each month
+        search->ordersForMonth_N[month]=orders_i; // Set the number of cars to be delivered in month i
+        money=stats[orders_i].mean;               // The profit for this strategy
 
-        // If there are less cars on the lot then orders that arrived in month i
-        else if(orders[i]<=arrivals[i]){
-            // You simply make $200K per car sold
-            Revenue+=sellFor*orders[i];
+        if(money>search->bestProfit){ // Test to see if this strategy is better then one already found
+            search->bestProfit=money; // if true then store this as the profit for the best strategy
+            search->orders[month]=orders_i; // Store the specified delivery amount to keep track of the best strategy
         }
+    }
+
+    /*
+      Test new stategy to see if it is better then the
+      already found strategy (money indicates the profit
+      of the new strategy and best profit indicates the
+      best of all tested strategies)
+     */
+
+    if(money<search->bestProfit){
+        copy(search->orders, search->orders+12,
+             search->bestOrders);
+    }
+
+    // Make a copy of the array containing the
+    // simulations previous optimal outcome to
+    // test the next set of possibilities
+    copy(search->orders,search->orders+12,
+         search->ordersForMonth_N);
+
+    // Move on to the next month, and after December to the next numOfOrders
+    if(++search->month==12){
+        search->month=0;
+        search->numOfOrders++;
+    }
+
+    ArenaRelease(scratch, mark);
+}
+
+// Run the search from wherever it is to the end, printing the best strategy after each
+// pass through the months. If checkpoint is not NULL, the search is saved to that file
+// every interval seconds and when it finishes (see SearchSave()).
+void OrderSearch(Search *search, Evaluator evaluate, void *context, const char *checkpoint, double interval){
+    double last=WallSeconds(), saved=last;
+
+    // Header showing the user the months that the order deliveries start and end
+    // also includes number of cars to order, the overall progress and the simulated
+    // expected profit
+    cout << "Jan " << "Feb " << "Mar " << "Apr " << "May "
+         << "Jun " << "Jul " << "Aug " << "Sep " << "Oct "
+         << "Nov " << "Dec " << "Cars " << "   Profit "
+         << " progress" << "\n";
+
+    // Range indicates the max number of car delivered in a month
+    while(search->numOfOrders<25){
+        SearchStep(search, evaluate, context);
+
+        double now=WallSeconds();
+        search->seconds+=now-last;
+        last=now;
+
+        if(search->month==0){
+            cout << " ";   int cars=0;  // Variable used to store the number of cars
+            for(int c=0; c<12; c++){
+                cout << search->bestOrders[c] << "   "; // Displays the best orders
+                cars+=search->bestOrders[c];            // Calculates the number of cars
+            }
+            // Display the optimal number of cars for the simulation, the expected profit the
+            // search estimated for it, and progress
+            cout << cars << "    "  << search->bestProfit << "   " << search->numOfOrders-5 << "-"  << 20 << "\n";
+        }
+
+        if(checkpoint!=NULL){
+            if(now-saved>=interval || search->numOfOrders==25){
+                if(!SearchSave(search, checkpoint))
+                    cout << "Could not write the checkpoint " << checkpoint << ".\n";
+                saved=now;
+            }
+        }
+    }
+}
+
+// A good strategy that a run of the order search settled on, used by the modes that study
+// one strategy. The search's answer depends on the random numbers, so it need not be the
+// strategy that main() prints.
+static const int referenceOrders[12]={8, 5, 4, 5, 4, 4, 3, 4, 4, 3, 3, 0};
+
+//////////////////////////////////////////////////////////////////////////////////////////
+// Sharded search: a coordinator process runs OrderSearch() and hands the strategies of
+// each step out to worker processes, round robin, over a Unix socket pair per worker.
+// Workers compute ProfitEstimate() with the step's seed, so the coordinator gets back
+// exactly the statistics it would have computed itself and prints the same answer as
+// the single-process search.
+//
+// Protocol, in native byte order (both ends are the same program on the same machine):
+//   coordinator -> worker: int count, unsigned int seed, count x 12 ints of orders
+//   worker -> coordinator: count ProfitStats
+// A count of -1 tells the worker to exit.
+
+#ifndef _WIN32
+
+// Write or read exactly n bytes, however the socket splits them up
+static int WriteAll(int fd, const void *buf, size_t n){
+    const char *p=(const char *) buf;
+    while(n>0){
+        ssize_t k=write(fd, p, n);
+        if(k<=0)
+            return (0);
+        p+=k; n-=k;
+    }
+    return (1);
+}
+
+static int ReadAll(int fd, void *buf, size_t n){
+    char *p=(char *) buf;
+    while(n>0){
+        ssize_t k=read(fd, p, n);
+        if(k<=0)
+            return (0);
+        p+=k; n-=k;
+    }
+    return (1);
+}
+
+// The worker's side: answer requests until told to stop (or the coordinator is gone)
+static void ShardWorker(int fd){
+    int count;
+    unsigned int seed;
+
+    Arena *scratch=ThreadArena();
+
+    while(ReadAll(fd, &count, sizeof(count)) && count>=0 && ReadAll(fd, &seed, sizeof(seed))){
+        int (*candidates)[12]=(int (*)[12]) ArenaAlloc(scratch, count*sizeof(*candidates));
+        ProfitStats *stats=(ProfitStats *) ArenaAlloc(scratch, count*sizeof(ProfitStats));
+
+        if(!ReadAll(fd, candidates, count*sizeof(*candidates)))
+            break;
+        LocalEvaluator(count, candidates, seed, stats, NULL);
+        WriteAll(fd, stats, count*sizeof(ProfitStats));
+
+        ArenaReset(scratch);
+    }
+    close(fd);
+}
+
+// The coordinator's evaluator: strategy k goes to worker k%workers. All requests are sent
+// before any answer is read, so the workers run at the same time.
+void ShardEvaluator(int count, int candidates[][12], unsigned int seed, ProfitStats stats[], void *context){
+    Shards *shards=(Shards *) context;
+    Arena *scratch=ThreadArena();
+    size_t mark=ArenaMark(scratch);
+    int (*mine)[12]=(int (*)[12]) ArenaAlloc(scratch, count*sizeof(*mine));
+    ProfitStats *theirs=(ProfitStats *) ArenaAlloc(scratch, count*sizeof(ProfitStats));
+
+    for(int w=0; w<shards->workers; w++){
+        int n=0;
+        for(int k=w; k<count; k+=shards->workers)
+            copy(candidates[k], candidates[k]+12, mine[n++]);
+        if(!WriteAll(shards->fd[w], &n, sizeof(n)) || !WriteAll(shards->fd[w], &seed, sizeof(seed))
+           || !WriteAll(shards->fd[w], mine, n*sizeof(*mine))){
+            printf("Lost worker %d of the sharded search.\n", w+1);
+            Pause();
+        }
+    }
+
+    for(int w=0; w<shards->workers; w++){
+        int n=(count-w+shards->workers-1)/shards->workers;
+        if(n>0 && !ReadAll(shards->fd[w], theirs, n*sizeof(ProfitStats))){
+            printf("Lost worker %d of the sharded search.\n", w+1);
+            Pause();
+        }
+        for(int k=w, j=0; k<count; k+=shards->workers)
+            stats[k]=theirs[j++];
+    }
+
+    ArenaRelease(scratch, mark);
+}
+
+// shard K
+// Runs the search of main() with K worker processes.
+int ShardMain(int argc, char *argv[]){
+    Shards shards;
+
+    shards.workers=(argc>0) ? atoi(argv[0]) : 2;
+    if(shards.workers<1){
+        cout << "usage: shard K   (K >= 1 worker processes)\n";
+        return (1);
+    }
+    shards.fd=(int *) malloc(shards.workers*sizeof(int));
+    shards.pid=(pid_t *) malloc(shards.workers*sizeof(pid_t));
+
+    // Start the workers, each with its own socket pair
+    cout.flush();
+    fflush(stdout);
+    for(int w=0; w<shards.workers; w++){
+        int sv[2];
+        if(socketpair(AF_UNIX, SOCK_STREAM, 0, sv)!=0){
+            printf("Cannot create a socket pair for the sharded search.\n");
+            Pause();
+        }
+        shards.pid[w]=fork();
+        if(shards.pid[w]==0){
+            // The worker keeps only its own end of its own pair
+            for(int v=0; v<w; v++)
+                close(shards.fd[v]);
+            close(sv[0]);
+            ShardWorker(sv[1]);
+            _exit(0);
+        }
+        close(sv[1]);
+        shards.fd[w]=sv[0];
+    }
+
+    // Seed the RNG.
+    MTUniform (1);
+
+    Search search;
+    SearchStart(&search, 1);
+
+    clock_t start=clock();
+    double wall=WallSeconds();
+    OrderSearch(&search, ShardEvaluator, &shards, NULL, 0);
+
+    // Stop the workers
+    for(int w=0; w<shards.workers; w++){
+        int stop=-1;
+        WriteAll(shards.fd[w], &stop, sizeof(stop));
+        close(shards.fd[w]);
+        waitpid(shards.pid[w], NULL, 0);
+    }
+
+    cout << "Computations took " << WallSeconds()-wall << " seconds with "
+         << shards.workers << " workers (" << double(clock()-start)/CLOCKS_PER_SEC
+         << " seconds in the coordinator).\n";
+
+    free(shards.fd);
+    free(shards.pid);
+    return (0);
+}
+
+#else
+
+int ShardMain(int argc, char *argv[]){
+    cout << "The sharded search needs fork() and Unix sockets.\n";
+    return (1);
+}
+
+#endif
+
+//////////////////////////////////////////////////////////////////////////////////////////
+// Checkpoints. A long search can be saved to a small binary file and resumed from it; the
+// resumed run continues exactly where the saved one was, printing the same numbers the
+// uninterrupted run would have. The file holds everything the rest of the search depends
+// on, which is the Search itself: position, strategies, seed stream and running totals.
+//
+// Layout, in native byte order: "RMCK", int version, int numOfOrders, int month,
+// int ordersForMonth_N[12], int orders[12], int bestOrders[12], double bestProfit,
+// long long evaluations, long long replications, double seconds, MTState seeds.
+
+static const int checkpointVersion=2;
+
+// Seconds on the wall clock (clock() only counts this process's own CPU time)
+double WallSeconds(){
+#ifndef _WIN32
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return (t.tv_sec+t.tv_nsec*1e-9);
+#else
+    return (double(clock())/CLOCKS_PER_SEC);
+#endif
+}
+
+// Save the search to fileName. The file is written under a temporary name and then
+// renamed, so an interruption never leaves a half-written checkpoint behind. Returns 1 on
+// success.
+int SearchSave(const Search *search, const char *fileName){
+    char tmpName[1024];
+    FILE *fp;
+    int ok;
+
+    snprintf(tmpName, sizeof(tmpName), "%s.tmp", fileName);
+    if((fp=fopen(tmpName, "wb"))==NULL)
+        return (0);
+
+    ok=fwrite("RMCK", 1, 4, fp)==4
+       && fwrite(&checkpointVersion, sizeof(int), 1, fp)==1
+       && fwrite(&search->numOfOrders, sizeof(int), 1, fp)==1
+       && fwrite(&search->month, sizeof(int), 1, fp)==1
+       && fwrite(search->ordersForMonth_N, sizeof(int), 12, fp)==12
+       && fwrite(search->orders, sizeof(int), 12, fp)==12
+       && fwrite(search->bestOrders, sizeof(int), 12, fp)==12
+       && fwrite(&search->bestProfit, sizeof(double), 1, fp)==1
+       && fwrite(&search->evaluations, sizeof(long long), 1, fp)==1
+       && fwrite(&search->replications, sizeof(long long), 1, fp)==1
+       && fwrite(&search->seconds, sizeof(double), 1, fp)==1
+       && fwrite(&search->seeds, sizeof(MTState), 1, fp)==1;
+    ok=(fclose(fp)==0) && ok;
+
+    return (ok && rename(tmpName, fileName)==0);
+}
+
+// Load a search saved by SearchSave(). Returns 1 on success and 0 if the file is missing
+// or is not a checkpoint of this version.
+int SearchLoad(Search *search, const char *fileName){
+    char magic[4];
+    int version;
+    Search loaded;
+    FILE *fp;
+    int ok;
+
+    if((fp=fopen(fileName, "rb"))==NULL)
+        return (0);
+
+    ok=fread(magic, 1, 4, fp)==4 && !memcmp(magic, "RMCK", 4)
+       && fread(&version, sizeof(int), 1, fp)==1 && version==checkpointVersion
+       && fread(&loaded.numOfOrders, sizeof(int), 1, fp)==1
+       && fread(&loaded.month, sizeof(int), 1, fp)==1
+       && fread(loaded.ordersForMonth_N, sizeof(int), 12, fp)==12
+       && fread(loaded.orders, sizeof(int), 12, fp)==12
+       && fread(loaded.bestOrders, sizeof(int), 12, fp)==12
+       && fread(&loaded.bestProfit, sizeof(double), 1, fp)==1
+       && fread(&loaded.evaluations, sizeof(long long), 1, fp)==1
+       && fread(&loaded.replications, sizeof(long long), 1, fp)==1
+       && fread(&loaded.seconds, sizeof(double), 1, fp)==1
+       && fread(&loaded.seeds, sizeof(MTState), 1, fp)==1;
+    fclose(fp);
+
+    // A truncated or edited file must not send the search or its seed generator out of
+    // bounds: the search runs numOfOrders from 5 to 25 over months 0 to 11, trying 0 to
+    // numOfOrders-1 cars a month, and the generator's next word is 0 to 624
+    ok=ok && loaded.numOfOrders>=5 && loaded.numOfOrders<=25
+       && loaded.month>=0 && loaded.month<12
+       && loaded.seeds.i0>=0 && loaded.seeds.i0<=624;
+    for(int c=0; c<12 && ok; c++)
+        ok=loaded.ordersForMonth_N[c]>=0 && loaded.ordersForMonth_N[c]<loaded.numOfOrders
+           && loaded.orders[c]>=0 && loaded.orders[c]<loaded.numOfOrders
+           && loaded.bestOrders[c]>=0 && loaded.bestOrders[c]<loaded.numOfOrders;
+    if(!ok)
+        return (0);
+
+    loaded.sink=NULL;
+    *search=loaded;
+    return (1);
+}
+
+// checkpoint file [seconds]   or   resume file [seconds]
+// Runs the search of main(), saving it to file every so many seconds (60 by default), or
+// resumes a saved search and carries on saving to the same file.
+int CheckpointMain(int argc, char *argv[], int resume){
+    Search search;
+    double interval=(argc>1) ? atof(argv[1]) : 60;
+
+    if(argc<1){
+        cout << "usage: checkpoint file [seconds]  or  resume file [seconds]\n";
+        return (1);
+    }
+
+    if(resume){
+        if(!SearchLoad(&search, argv[0])){
+            cout << "Cannot resume from " << argv[0] << ".\n";
+            return (1);
+        }
+        cout << "Resuming at " << search.numOfOrders << " cars, month " << search.month+1
+             << " (" << search.evaluations << " strategies estimated).\n";
+    }
+    else{
+        // Seed the RNG.
+        MTUniform (1);
+        SearchStart(&search, 1);
+    }
+
+    OrderSearch(&search, LocalEvaluator, NULL, argv[0], interval);
+
+    cout << "Computations took " << search.seconds << " seconds (" << search.evaluations
+         << " strategies, " << search.replications << " simulated years).\n";
+    cout << "Scratch memory: " << ThreadArena()->peak/1024 << " KB at most, "
+         << ThreadArena()->mallocs << " blocks from the heap.\n";
+    return (0);
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////
+// Gradient search. Instead of estimating the profit of thousands of neighbouring
+// strategies, SgdSearch() follows the pathwise gradient of ProfitCalcGrad(): projected
+// stochastic gradient ascent over real-valued orders in [0,maxOrders], then a short
+// SPSA-style refinement on whole numbers of cars, where the gradient, being a forward
+// difference, can no longer tell whether a month would do better with one car less.
+
+// Estimate the expected profit of Orders and its gradient from reps years drawn from mt
+void ProfitGradient(int Orders[], MTState *mt, int reps, double *mean, double grad[]){
+    double sampleArrivals[12], pathGrad[12];
+
+    *mean=0;
+    for(int c=0; c<12; c++)
+        grad[c]=0;
+
+    for(int i=1; i<=reps; i++){
+        YearArrivals(sampleArrivals, mt);
+        double profit=ProfitCalcGrad(sampleArrivals, Orders, pathGrad);
+        *mean+=(profit-*mean)/i;
+        for(int c=0; c<12; c++)
+            grad[c]+=(pathGrad[c]-grad[c])/i;
+    }
+}
+
+// Search for the best strategy with iterations gradient steps of batch years each,
+// followed by refine SPSA steps; the result is left in orders[]
+void SgdSearch(int orders[], int iterations, int batch, int refine, unsigned int seed){
+    const int maxOrders=24;         // Same range as the order search of main()
+    const double a=0.05, A=50;      // Step size a/(1+k/A)^0.602
+    double x[12], average[12], grad[12], mean;
+    int current[12], candidates[3][12];
+    ProfitStats stats[3];
+    MTState mt, seeds;
+    int k, c;
+
+    MTSeed(&mt, seed);
+    MTSeed(&seeds, seed^0x9e3779b9u);
+    for(c=0; c<12; c++)
+        x[c]=average[c]=0;
+
+    // Projected stochastic gradient ascent; the gradient is taken at the nearest whole
+    // strategy, and the iterates of the second half are averaged
+    for(k=0; k<iterations; k++){
+        for(c=0; c<12; c++)
+            current[c]=int(x[c]+0.5);
+        ProfitGradient(current, &mt, batch, &mean, grad);
+
+        double step=a/pow(1+k/A, 0.602);
+        for(c=0; c<12; c++){
+            x[c]+=step*grad[c];
+            x[c]=(x[c]<0) ? 0 : (x[c]>maxOrders) ? maxOrders : x[c];
+        }
+
+        if(2*k>=iterations)
+            for(c=0; c<12; c++)
+                average[c]+=(x[c]-average[c])/(k-iterations/2+1);
+    }
+    for(c=0; c<12; c++)
+        orders[c]=int(average[c]+0.5);
+
+    // Refinement: perturb a few months by one car either way, and keep the best of the
+    // three strategies, all estimated with the same seed
+    for(k=0; k<refine; k++){
+        for(c=0; c<12; c++){
+            unsigned int u=MTNext(&mt);
+            int delta=(u%6==0) ? 1 : (u%6==1) ? -1 : 0;
+            candidates[0][c]=orders[c];
+            candidates[1][c]=orders[c]+delta;
+            candidates[2][c]=orders[c]-delta;
+            for(int j=1; j<3; j++)
+                candidates[j][c]=(candidates[j][c]<0) ? 0 :
+                                 (candidates[j][c]>maxOrders) ? maxOrders : candidates[j][c];
+        }
+
+        unsigned int s=MTNext(&seeds);
+        LocalEvaluator(3, candidates, s ? s : 1, stats, NULL);
+
+        int best=0;
+        for(int j=1; j<3; j++)
+            if(stats[j].mean>stats[best].mean)
+                best=j;
+        copy(candidates[best], candidates[best]+12, orders);
+    }
+}
+
+// sgd [iterations [batch [refine [seed]]]]
+// Runs SgdSearch() and prints the strategy found in the same form as the order search.
+int SgdMain(int argc, char *argv[]){
+    int iterations=(argc>0) ? atoi(argv[0]) : 2000,
+        batch     =(argc>1) ? atoi(argv[1]) : 100,
+        refine    =(argc>2) ? atoi(argv[2]) : 50;
+    unsigned int seed=(argc>3) ? strtoul(argv[3], NULL, 10) : 1;
+    int orders[12], cars=0;
+    double grad[12];
+
+    // Seed the RNG.
+    MTUniform (1);
+
+    clock_t start=clock();
+    SgdSearch(orders, iterations, batch, refine, seed);
+
+    cout << "Jan " << "Feb " << "Mar " << "Apr " << "May "
+         << "Jun " << "Jul " << "Aug " << "Sep " << "Oct "
+         << "Nov " << "Dec " << "Cars " << "   Profit\n";
+    cout << " ";
+    for(int c=0; c<12; c++){
+        cout << orders[c] << "   ";
+        cars+=orders[c];
+    }
+    cout << cars << "    " << Profit(orders, grad) << "\n";
+
+    cout << "Gradient:";
+    for(int c=0; c<12; c++)
+        cout << " " << grad[c];
+    cout << "\nComputations took " << double(clock()-start)/CLOCKS_PER_SEC << " seconds.\n";
+    return (0);
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////
+// Sample average approximation. N simulated years are drawn once and the strategy with
+// the highest average ProfitCalc over them is found exactly; repeating this over
+// independent batches bounds how far a strategy is from the true optimum.
+//
+// The years share one strategy but each carries its own inventory, so the problem does
+// not reduce to a dynamic programme over a single carried stock. Written in terms of the
+// cumulative orders Q[i]=Orders[0]+...+Orders[i], though, every year's profit is
+// 50*Q[11] less carrying and clearance losses that are L-natural convex in Q (the
+// carry-over obeys c=max(0,c+Orders[i]-arrivals[i])). So the average profit is
+// L-natural concave, and a strategy that no move Q+-(1 on a set of months) improves is
+// optimal (Murota, Discrete Convex Analysis, 2003). SaaSolve() climbs by the best such
+// move until there is none. The same holds for a year that starts with cars on the lot
+// and values the cars left over at any salvage price below sellFor (ProfitCalcCarry()).
+
+// The average profit of Orders over the years in the rows of years (12 months each),
+// starting each with stock cars and selling what is left for salvage
+double SaaObjective(Matrix years, int Orders[], double stock, double salvage){
+    double total=0;
+    for(int s=0; s<years.rows; s++)
+        total+=ProfitCalcCarry(MatrixRow(years, s), Orders, stock, salvage, NULL);
+    return (total/years.rows);
+}
+
+// Add to total[X] the profit of one year's arrivals under Orders moved by dir on every
+// set X of months, as in SaaSolve(). The sets are enumerated month by month, so sets with
+// the same first months share the simulation of those months: 2^13 month updates per
+// year rather than 12*2^12. Sets that would take a month's order out of [0,maxOrders]
+// are skipped.
+static void SaaMoves(const double arrivals[], const int Orders[], int dir, int maxOrders, double salvage,
+                     int i, int previous, int X, double carry, double value, double total[]){
+    const double costPer=150, sellFor=200, carryCost=10.0/12;
+
+    if(i==12){
+        total[X]+=value+salvage*carry;
+        return;
+    }
+
+    for(int bit=0; bit<=1; bit++){
+        int orders=Orders[i]+dir*(bit-previous);
+        if(orders<0 || orders>maxOrders)
+            continue;
+
+        double stock=orders+carry, v=value-costPer*orders;
+        if(stock>arrivals[i])
+            SaaMoves(arrivals, Orders, dir, maxOrders, salvage, i+1, bit, X|(bit<<i),
+                     stock-arrivals[i], v+sellFor*arrivals[i]-carryCost*(stock-arrivals[i]), total);
+        else
+            SaaMoves(arrivals, Orders, dir, maxOrders, salvage, i+1, bit, X|(bit<<i), 0, v+sellFor*stock, total);
+    }
+}
+
+// Find the optimal strategy for the years in the rows of years, each starting with stock
+// cars and selling its leftovers for salvage (75, the clearance price, in ProfitCalc()),
+// starting the search from Orders, which is overwritten. simulated, if not NULL, is
+// increased by the work done, counted in simulated years as ProfitCalc() does them.
+double SaaSolve(Matrix years, int Orders[], double stock, double salvage, long long *simulated){
+    const int maxOrders=24;     // Same range as the order search of main()
+    const double delivery=20;
+    Arena *scratch=ThreadArena();
+    size_t mark=ArenaMark(scratch);
+    double *total=(double *) ArenaAlloc(scratch, 2*4096*sizeof(double));
+    long long monthUpdates=0;
+    int N=years.rows;
+
+    while(1){
+        // total[X] and total[4096+X]: Q+(1 on X) and Q-(1 on X); X=0 is Orders itself
+        for(int X=0; X<2*4096; X++)
+            total[X]=(X%4096==0) ? 0 : -HUGE_VAL;
+        for(int X=1; X<4096; X++){
+            int up=1, down=1;
+            for(int i=0; i<12; i++){
+                int d=((X>>i)&1)-(i>0 ? (X>>(i-1))&1 : 0);
+                up  =up   && Orders[i]+d>=0 && Orders[i]+d<=maxOrders;
+                down=down && Orders[i]-d>=0 && Orders[i]-d<=maxOrders;
+            }
+            if(up)   total[X]=0;
+            if(down) total[4096+X]=0;
+        }
+
+        for(int s=0; s<N; s++){
+            SaaMoves(MatrixRow(years, s), Orders, 1, maxOrders, salvage, 0, 0, 0, stock, -delivery, total);
+            SaaMoves(MatrixRow(years, s), Orders, -1, maxOrders, salvage, 0, 0, 0, stock, -delivery, total+4096);
+        }
+        monthUpdates+=2*8190LL*N;
+
+        // The best move, if any improves on Orders
+        int best=0;
+        for(int X=1; X<2*4096; X++)
+            if(X!=4096 && total[X]>total[best]+1e-7*N)
+                best=X;
+        if(best==0)
+            break;
+
+        int dir=(best<4096) ? 1 : -1, X=best%4096;
+        for(int i=11; i>=0; i--)
+            Orders[i]+=dir*(((X>>i)&1)-(i>0 ? (X>>(i-1))&1 : 0));
+    }
+
+    ArenaRelease(scratch, mark);
+    if(simulated!=NULL)
+        *simulated+=monthUpdates/12+N;
+    return (SaaObjective(years, Orders, stock, salvage));
+}
+
+// saa [N [batches [evaluationYears [seed]]]]
+// Solves batches independent SAA problems of N years each and reports bounds on the
+// optimal expected profit and on the optimality gap of the first batch's strategy:
+//   upper bound: the mean of the batch optima (biased upwards), plus its 95% margin;
+//   lower bound: the strategy's profit over evaluationYears fresh years, less its margin;
+//   gap: the mean over batches of (batch optimum - strategy's profit on that batch),
+//        plus its 95% margin (Mak, Morton and Wood 1999).
+int SaaMain(int argc, char *argv[]){
+    int N         =(argc>0) ? atoi(argv[0]) : 1000,
+        batches   =(argc>1) ? atoi(argv[1]) : 10,
+        evalYears =(argc>2) ? atoi(argv[2]) : 100000;
+    unsigned int seed=(argc>3) ? strtoul(argv[3], NULL, 10) : 1;
+    double sampleArrivals[12];
+    double sumV=0, sumV2=0, sumG=0, sumG2=0;
+    int candidate[12], orders[12];
+    long long years=0;
+    MTState mt;
+
+    if(N<1 || batches<2 || evalYears<2){
+        cout << "usage: saa [N [batches (at least 2) [evaluationYears [seed]]]]\n";
+        return (1);
+    }
+    MTSeed(&mt, seed);
+    clock_t start=clock();
+    Matrix bank=MatrixCreate(N, 12, NULL);   // One simulated year per row
+
+    cout << "Batch  Jan Feb Mar Apr May Jun Jul Aug Sep Oct Nov Dec Cars    Optimum\n";
+    for(int b=0; b<batches; b++){
+        for(int s=0; s<N; s++)
+            YearArrivals(MatrixRow(bank, s), &mt);
+
+        // Start the first batch from its average monthly arrivals, and the others
+        // from the optimum of the batch before
+        for(int c=0; c<12 && b==0; c++){
+            double mean=0;
+            for(int s=0; s<N; s++)
+                mean+=MatrixRow(bank, s)[c];
+            orders[c]=int(mean/N+0.5);
+        }
+
+        double v=SaaSolve(bank, orders, 0, 75, &years);
+        if(b==0)
+            copy(orders, orders+12, candidate);
+        double g=v-SaaObjective(bank, candidate, 0, 75);
+        years+=N;
+
+        sumV+=v;  sumV2+=v*v;
+        sumG+=g;  sumG2+=g*g;
+
+        int cars=0;
+        cout << " " << b+1 << "    ";
+        for(int c=0; c<12; c++){
+            cout << orders[c] << "   ";
+            cars+=orders[c];
+        }
+        cout << cars << "    " << v << "\n";
+    }
+
+    // Estimate the candidate's expected profit from fresh years
+    double mean=0, m2=0;
+    for(int i=1; i<=evalYears; i++){
+        YearArrivals(sampleArrivals, &mt);
+        double profit=ProfitCalc(sampleArrivals, candidate);
+        mean+=(profit-mean)/i;
+        m2  +=(profit*profit-m2)/i;
+    }
+    years+=evalYears;
+
+    // Student t quantile for batches-1 degrees of freedom (97.5%)
+    double t=StudentTInv(0.975, batches-1);
+    double meanV=sumV/batches, sdV=sqrt(fmax(0, (sumV2-batches*meanV*meanV)/(batches-1)));
+    double meanG=sumG/batches, sdG=sqrt(fmax(0, (sumG2-batches*meanG*meanG)/(batches-1)));
+    double lower=mean-1.96*sqrt(fmax(0, m2-mean*mean)/evalYears), upper=meanV+t*sdV/sqrt(batches);
+
+    cout << "Strategy of batch 1 is worth " << mean << " (lower bound " << lower << ")\n";
+    cout << "Optimal profit is at most " << upper << " (mean of the batch optima " << meanV << ")\n";
+    cout << "Optimality gap is at most " << upper-lower << " by the bounds, "
+         << meanG+t*sdG/sqrt(batches) << " by the paired estimate\n";
+    cout << "Simulated years: " << years << "\n";
+    cout << "Computations took " << double(clock()-start)/CLOCKS_PER_SEC << " seconds.\n";
+
+    MatrixFree(&bank);
+    return (0);
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////
+// Rolling horizon. ProfitCalc() sells the cars left at the end of the year at clearance;
+// here they roll into the next year instead, and only the cars left after the last year
+// of the study are cleared. Each year's orders are planned at its start, knowing the
+// cars on the lot, by SaaSolve() over a fixed bank of simulated years, valuing leftovers
+// at costPer (a car carried over is one less to buy) except in the last year. The plan
+// depends only on the stock and on whether the year is the last, and the stock is a whole
+// number of cars, so plans are kept by stock and each is worked out once: a study of many
+// paths and years costs a few SAA solves plus one ProfitCalcCarry() per simulated year.
+// The years themselves are streamed, year y of path p being YearArrivalsAt(seed, p*years+y).
+
+typedef struct {
+    Matrix bank;            // Years the plans are optimised over
+    int maxStock;           // Plans are kept for stocks 0,...,maxStock-1
+    int (*plan)[12];        // plan[2*stock+last]
+    char *known;            // known[2*stock+last] once the plan is worked out
+    int guess[12];          // Where a search starts when no plan is known yet
+    int solves;
+    long long simulated;    // Work done by SaaSolve(), in simulated years
+} RollingPlans;
+
+// The orders for a year starting with stock cars on the lot
+static const int *RollingPlan(RollingPlans *plans, int stock, int last){
+    const double costPer=150, clearance=75;
+    static int uncached[12];
+    int *plan=uncached;
+
+    if(stock<plans->maxStock){
+        plan=plans->plan[2*stock+last];
+        if(plans->known[2*stock+last])
+            return (plan);
+        plans->known[2*stock+last]=1;
+    }
+
+    // Start from the plan for the nearest stock already worked out, with January's
+    // order changed by the difference in stock, which is usually optimal or close to it
+    copy(plans->guess, plans->guess+12, plan);
+    for(int d=1; d<plans->maxStock; d++){
+        int near=(stock-d>=0 && stock-d<plans->maxStock && plans->known[2*(stock-d)+last]) ? stock-d :
+                 (stock+d<plans->maxStock && plans->known[2*(stock+d)+last]) ? stock+d : -1;
+        if(near>=0){
+            copy(plans->plan[2*near+last], plans->plan[2*near+last]+12, plan);
+            plan[0]+=near-stock;
+            plan[0]=(plan[0]<0) ? 0 : (plan[0]>24) ? 24 : plan[0];
+            break;
+        }
+    }
+
+    SaaSolve(plans->bank, plan, stock, last ? clearance : costPer, &plans->simulated);
+    plans->solves++;
+    return (plan);
+}
+
+// rolling [years [paths [N [seed]]]]
+// Simulates paths runs of years consecutive years each, carrying inventory from year to
+// year and planning every year as above with a bank of N years. For comparison, the same
+// years are also run the old way, with the static plan optimised for a year that starts
+// empty and clears its leftovers.
+int RollingMain(int argc, char *argv[]){
+    int years=(argc>0) ? atoi(argv[0]) : 20,
+        paths=(argc>1) ? atoi(argv[1]) : 1000,
+        N    =(argc>2) ? atoi(argv[2]) : 200;
+    unsigned int seed=(argc>3) ? strtoul(argv[3], NULL, 10) : 1;
+    RollingPlans plans;
+    MTState mt;
+    int staticPlan[12];
+    double sampleArrivals[12];
+
+    if(years<1 || paths<2 || N<1){
+        cout << "usage: rolling [years [paths (at least 2) [N [seed]]]]\n";
+        return (1);
+    }
+    clock_t start=clock();
+
+    plans.bank=MatrixCreate(N, 12, NULL);
+    MTSeed(&mt, seed^0x5bd1e995u);
+    for(int s=0; s<N; s++)
+        YearArrivals(MatrixRow(plans.bank, s), &mt);
+    plans.maxStock=256;
+    plans.plan=(int (*)[12]) malloc(2*plans.maxStock*sizeof(*plans.plan));
+    plans.known=(char *) calloc(2*plans.maxStock, 1);
+    plans.solves=0;
+    plans.simulated=0;
+
+    // The static plan, which is also where the searches start
+    for(int c=0; c<12; c++)
+        staticPlan[c]=4;
+    SaaSolve(plans.bank, staticPlan, 0, 75, &plans.simulated);
+    copy(staticPlan, staticPlan+12, plans.guess);
+
+    double *yearMean=(double *) calloc(years, sizeof(double)),
+           *stockMean=(double *) calloc(years, sizeof(double));
+    double mean=0, m2=0, staticMean=0, staticM2=0, diffMean=0, diffM2=0;
+
+    for(int p=0; p<paths; p++){
+        double stock=0, total=0, staticTotal=0;
+
+        for(int y=0; y<years; y++){
+            int last=(y==years-1);
+            double left;
+
+            YearArrivalsAt(sampleArrivals, seed, (unsigned int) (p*years+y));
+            const int *plan=RollingPlan(&plans, int(stock), last);
+            double profit=ProfitCalcCarry(sampleArrivals, (int *) plan, stock, last ? 75 : 0, &left);
+
+            stockMean[y]+=(stock-stockMean[y])/(p+1);
+            yearMean[y] +=(profit-yearMean[y])/(p+1);
+            total+=profit;
+            stock=left;
+
+            staticTotal+=ProfitCalc(sampleArrivals, staticPlan);
+        }
+
+        mean      +=(total-mean)/(p+1);             m2      +=(total*total-m2)/(p+1);
+        staticMean+=(staticTotal-staticMean)/(p+1); staticM2+=(staticTotal*staticTotal-staticM2)/(p+1);
+        double diff=total-staticTotal;
+        diffMean  +=(diff-diffMean)/(p+1);          diffM2  +=(diff*diff-diffM2)/(p+1);
+    }
+
+    cout << "Year  Stock at start    Profit\n";
+    for(int y=0; y<years; y++)
+        cout << " " << y+1 << "     " << stockMean[y] << "    " << yearMean[y] << "\n";
+
+    cout << "Rolling horizon: " << mean << " +- " << 1.96*sqrt((m2-mean*mean)/paths)
+         << " over " << years << " years\n";
+    cout << "Static plan, clearing every year: " << staticMean << " +- "
+         << 1.96*sqrt((staticM2-staticMean*staticMean)/paths) << "\n";
+    cout << "Difference: " << diffMean << " +- " << 1.96*sqrt((diffM2-diffMean*diffMean)/paths) << "\n";
+    cout << "Plans worked out: " << plans.solves << " (" << plans.simulated << " simulated years), "
+         << "years simulated: " << (long long) paths*years << "\n";
+    cout << "Computations took " << double(clock()-start)/CLOCKS_PER_SEC << " seconds.\n";
+
+    MatrixFree(&plans.bank);
+    free(plans.plan);
+    free(plans.known);
+    free(yearMean);
+    free(stockMean);
+    return (0);
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////
+// Replenishment policies. Instead of a fixed number of cars for each month, an (s,S)
+// policy looks at the inventory position (cars on the lot plus cars ordered but not yet
+// delivered) at the start of every month, and if it is s or less orders enough to bring
+// it up to S; base-stock S is the (s,S) policy with s=S-1. Cars ordered arrive lead
+// months later, and nothing is ordered that would arrive after December. Prices and
+// costs are those of ProfitCalc(), which is the case of lead time 0 with orders fixed
+// in advance.
+//
+// The scenarios are a bank of years stored month by month (row m holds month m of every
+// year), so that VEC_WIDTH years go through a policy side by side, and the whole grid of
+// policies is run over one block of the bank while it is in cache.
+
+// Add every policy's profits over the bank to sum[] and sumSquares[]; policy k is
+// (s[k],S[k]), with lead time lead
+void PolicyGrid(Matrix bank, int years, int lead, int policies, const int s[], const int S[],
+                double sum[], double sumSquares[]){
+    const double costPer=150, sellFor=200, delivery=20, clearance=75, carryCost=10.0/12;
+    const int block=256;    // Years per block of the bank
+
+    for(int first=0; first<years; first+=block){
+        int last=(first+block<years) ? first+block : years;
+
+        for(int k=0; k<policies; k++){
+            VecD reorder={}, upTo={}, total={}, squares={};
+            reorder+=s[k];
+            upTo+=S[k];
+
+            for(int j=first; j<last; j+=VEC_WIDTH){
+                VecD onLot={}, onOrder={}, profit={}, due[12]={};
+                profit-=delivery;
+
+                for(int m=0; m<12; m++){
+                    // Review: order up to S if the position is down to s
+                    if(m+lead<12){
+                        VecD position=onLot+onOrder, zero={};
+                        VecD order=(position<=reorder) ? upTo-position : zero;
+                        due[m+lead]+=order;
+                        onOrder+=order;
+                        profit-=costPer*order;
+                    }
+
+                    // Deliveries, then sales, then the cars held over the month
+                    onLot+=due[m];
+                    onOrder-=due[m];
+                    VecD arrived=VecLoad(MatrixRow(bank, m)+j);
+                    VecD sale=(onLot<arrived) ? onLot : arrived;
+                    profit+=sellFor*sale;
+                    onLot-=sale;
+                    profit-=carryCost*onLot;
+                }
+                profit+=clearance*onLot;
+
+                // Years past the end of the bank are not counted
+                for(int l=0; l<VEC_WIDTH; l++)
+                    if(j+l>=last)
+                        profit[l]=0;
+                total+=profit;
+                squares+=profit*profit;
+            }
+
+            for(int l=0; l<VEC_WIDTH; l++){
+                sum[k]+=total[l];
+                sumSquares[k]+=squares[l];
+            }
+        }
+    }
+}
+
+// policy [lead [years [maxS [seed]]]]
+// Evaluates every (s,S) policy with -1 <= s < S <= maxS over the same simulated years,
+// and reports the best one, the best base-stock policy, and the profit of every
+// base-stock level.
+int PolicyMain(int argc, char *argv[]){
+    int lead =(argc>0) ? atoi(argv[0]) : 0,
+        years=(argc>1) ? atoi(argv[1]) : 100000,
+        maxS =(argc>2) ? atoi(argv[2]) : 30;
+    unsigned int seed=(argc>3) ? strtoul(argv[3], NULL, 10) : 1;
+    double sampleArrivals[12];
+
+    if(lead<0 || lead>11 || years<2 || maxS<0){
+        cout << "usage: policy [lead (0-11) [years [maxS [seed]]]]\n";
+        return (1);
+    }
+
+    // The grid
+    int policies=(maxS+1)*(maxS+2)/2, k=0;
+    int *s=(int *) malloc(policies*sizeof(int)), *S=(int *) malloc(policies*sizeof(int));
+    double *sum=(double *) calloc(policies, sizeof(double)), *sumSquares=(double *) calloc(policies, sizeof(double));
+    for(int up=0; up<=maxS; up++)
+        for(int re=-1; re<up; re++){
+            s[k]=re;
+            S[k]=up;
+            k++;
+        }
+
+    // The bank, one month per row; the columns run past years to a whole vector
+    clock_t start=clock();
+    Matrix bank=MatrixCreate(12, years+VEC_WIDTH, NULL);
+    for(int j=0; j<years; j++){
+        YearArrivalsAt(sampleArrivals, seed, j);
+        for(int m=0; m<12; m++)
+            MatrixRow(bank, m)[j]=sampleArrivals[m];
+    }
+    double generating=double(clock()-start)/CLOCKS_PER_SEC;
+
+    start=clock();
+    PolicyGrid(bank, years, lead, policies, s, S, sum, sumSquares);
+    double evaluating=double(clock()-start)/CLOCKS_PER_SEC;
+
+    int best=0, bestBase=-1;
+    for(k=0; k<policies; k++){
+        if(sum[k]>sum[best])
+            best=k;
+        if(s[k]==S[k]-1 && (bestBase<0 || sum[k]>sum[bestBase]))
+            bestBase=k;
+    }
+
+    cout << "Base-stock S    Profit\n";
+    for(k=0; k<policies; k++)
+        if(s[k]==S[k]-1)
+            cout << "    " << S[k] << "         " << sum[k]/years << "\n";
+
+    for(int pass=0; pass<2; pass++){
+        int b=pass ? bestBase : best;
+        double mean=sum[b]/years, half=1.96*sqrt((sumSquares[b]/years-mean*mean)/years);
+        cout << (pass ? "Best base-stock policy: S=" : "Best (s,S) policy: s=");
+        if(!pass)
+            cout << s[b] << " S=";
+        cout << S[b] << ", profit " << mean << " +- " << half << "\n";
+    }
+    cout << policies << " policies with lead time " << lead << " over " << years << " years: "
+         << generating << " seconds simulating the years, " << evaluating << " seconds on the policies.\n";
+
+    MatrixFree(&bank);
+    free(s); free(S); free(sum); free(sumSquares);
+    return (0);
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////
+// Importance sampling for the loss tail. Years with so few orders that a strategy loses
+// money are rare under 50 orders a year, so counting them among plain simulated years
+// takes an enormous number of years. Instead the years are simulated with orders
+// arriving at a lower rate, where such years are common, and each is weighted by the
+// likelihood ratio of the two Poisson processes over the year,
+//     w = (50/rate)^n exp(-(50-rate)),
+// where n is the number of orders in the year, which makes the weighted averages
+// unbiased for the real rate. The rate is found by the cross-entropy method (Rubinstein
+// and Kroese, The Cross-Entropy Method, 2004): from a pilot sample, the rate is moved to
+// the weighted mean of n over the worst tenth of the years, and the worst tenth's
+// boundary moves down to the threshold in a few rounds.
+
+// The likelihood ratio of a year with n orders simulated at rate instead of 50
+static double TailWeight(int n, double rate){
+    const double rate0=50;
+    return (exp(n*log(rate0/rate)-(rate0-rate)));
+}
+
+static int CompareDoubles(const void *a, const void *b){
+    double x=*(const double *) a, y=*(const double *) b;
+    return ((x>y)-(x<y));
+}
+
+// tail [threshold [years [seed [12 orders]]]]
+// Estimates the probability that a year's profit under the strategy (by default
+// referenceOrders) is below threshold, and the expected shortfall
+// E[(threshold-profit)+], by plain simulation and by importance sampling with the same
+// number of years.
+int TailMain(int argc, char *argv[]){
+    double threshold=(argc>0) ? atof(argv[0]) : 0;
+    int years=(argc>1) ? atoi(argv[1]) : 100000;
+    unsigned int seed=(argc>2) ? strtoul(argv[2], NULL, 10) : 1;
+    int Orders[12];
+    const int pilot=2000;
+    double sampleArrivals[12], rate=50;
+    MTState mt;
+
+    if(argc>=15)
+        for(int c=0; c<12; c++)
+            Orders[c]=atoi(argv[3+c]);
+    else if(argc>3){
+        cout << "usage: tail [threshold [years [seed [12 orders]]]]\n";
+        return (1);
+    }
+    else
+        copy(referenceOrders, referenceOrders+12, Orders);
+    if(years<2){
+        cout << "tail needs at least 2 years.\n";
+        return (1);
+    }
+    MTSeed(&mt, seed);
+    clock_t start=clock();
+
+    // Cross-entropy rounds
+    double *profit=(double *) malloc(pilot*sizeof(double)), *sorted=(double *) malloc(pilot*sizeof(double));
+    int *count=(int *) malloc(pilot*sizeof(int));
+    for(int round=0; round<20; round++){
+        for(int i=0; i<pilot; i++){
+            count[i]=YearArrivalsRate(sampleArrivals, &mt, rate);
+            profit[i]=ProfitCalc(sampleArrivals, Orders);
+        }
+        copy(profit, profit+pilot, sorted);
+        qsort(sorted, pilot, sizeof(double), CompareDoubles);
+        double gamma=sorted[pilot/10];
+        if(gamma<threshold)
+            gamma=threshold;
+
+        double weight=0, weighted=0;
+        for(int i=0; i<pilot; i++)
+            if(profit[i]<=gamma){
+                double w=TailWeight(count[i], rate);
+                weight+=w;
+                weighted+=w*count[i];
+            }
+        cout << "Cross-entropy round " << round+1 << ": rate " << rate << ", level " << gamma << "\n";
+        if(weight>0)
+            rate=weighted/weight;
+        if(gamma<=threshold)
+            break;
+    }
+    free(profit); free(sorted); free(count);
+    if(rate>50)
+        rate=50;
+
+    // Plain simulation and importance sampling, with the same number of years each
+    double plainHits=0, plainShort=0, plainShort2=0;
+    double isP=0, isP2=0, isShort=0, isShort2=0, w1=0, w2=0;
+    for(int i=0; i<years; i++){
+        YearArrivalsRate(sampleArrivals, &mt, 50);
+        double money=ProfitCalc(sampleArrivals, Orders);
+        if(money<threshold){
+            plainHits++;
+            plainShort +=threshold-money;
+            plainShort2+=(threshold-money)*(threshold-money);
+        }
+
+        int n=YearArrivalsRate(sampleArrivals, &mt, rate);
+        double w=TailWeight(n, rate);
+        money=ProfitCalc(sampleArrivals, Orders);
+        w1+=w;
+        w2+=w*w;
+        if(money<threshold){
+            isP +=w;
+            isP2+=w*w;
+            isShort +=w*(threshold-money);
+            isShort2+=w*(threshold-money)*w*(threshold-money);
+        }
+    }
+
+    double p=plainHits/years, ps=plainShort/years,
+           q=isP/years, qs=isShort/years;
+    double pHalf=1.96*sqrt(p*(1-p)/years), psHalf=1.96*sqrt((plainShort2/years-ps*ps)/years),
+           qHalf=1.96*sqrt((isP2/years-q*q)/years), qsHalf=1.96*sqrt((isShort2/years-qs*qs)/years);
+
+    cout << "Probability of a profit below " << threshold << ":\n";
+    cout << "   plain simulation    " << p << " +- " << pHalf << " (" << plainHits << " years below)\n";
+    cout << "   importance sampling " << q << " +- " << qHalf << " (rate " << rate << ")\n";
+    cout << "Expected shortfall below " << threshold << ":\n";
+    cout << "   plain simulation    " << ps << " +- " << psHalf << "\n";
+    cout << "   importance sampling " << qs << " +- " << qsHalf << "\n";
+    cout << "Effective sample size " << ((isP2>0) ? isP*isP/isP2 : 0) << " of the years below, "
+         << w1*w1/w2 << " of all " << years << " years";
+    if(q>0 && qHalf>0)
+        cout << "; plain simulation would need about " << q*(1-q)/(isP2/years-q*q)*years
+             << " years for the same accuracy";
+    cout << ".\nComputations took " << double(clock()-start)/CLOCKS_PER_SEC << " seconds.\n";
+    return (0);
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////
+// Philox4x32-10 behind the interface of MTUniform(): the first call seeds it with a
+// positive seed, and later calls return the next number of the stream of that key.
+double PhiloxUniform(unsigned int seed){
+    static unsigned int key[2], counter[4], words[64], used=64, seeded=0;
+
+    if(!seeded){
+        if(!seed){
+            printf("PhiloxUniform must be seeded with a postive integer.\n");
+            Pause();
+        }
+        key[0]=seed; key[1]=0x554e4946;
+        seeded=1;
+        return (0);
+    }
+    if(used==64){
+        PhiloxBatch(counter, key, words, 16);   // 16 counters of 4 words
+        counter[0]+=16;
+        used=0;
+    }
+    return (WordUniform(words[used++]));
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////
+// rng [draws [seed]]
+// Compares the uniform generators: their speed, the p-values of the statistical tests in
+// the function library, and what each does to Profit()'s estimate and running time for
+// referenceOrders. A p-value below 0.001 is marked as a failure.
+int RngMain(int argc, char *argv[]){
+    int draws=(argc>0) ? atoi(argv[0]) : 10000000;
+    unsigned int seed=(argc>1) ? strtoul(argv[1], NULL, 10) : 1;
+    int Orders[12];
+    struct {
+        const char *name;
+        double (*uniform)(unsigned int);
+    } generators[]={{"MTUniform", MTUniform}, {"LCGUniform", LCGUniform},
+                    {"MWCUniform", MWCUniform}, {"LCG64Uniform", LCG64Uniform},
+                    {"PhiloxUniform", PhiloxUniform}};
+    const int count=sizeof(generators)/sizeof(generators[0]);
+
+    if(draws<100000 || seed==0){
+        cout << "usage: rng [draws >= 100000 [seed > 0]]\n";
+        return (1);
+    }
+    copy(referenceOrders, referenceOrders+12, Orders);
+
+    // PhiloxUniform() draws its words in batches; they must be those of Philox() called
+    // one counter at a time
+    PhiloxUniform(seed);
+    for(unsigned int c=0; c<256; c++){
+        const unsigned int key[2]={seed, 0x554e4946}, counter[4]={c, 0, 0, 0};
+        unsigned int words[4];
+        Philox(counter, key, words);
+        for(int k=0; k<4; k++)
+            if(PhiloxUniform(0)!=WordUniform(words[k])){
+                printf("PhiloxUniform() differs from Philox() at counter %u, word %d.\n", c, k);
+                return (1);
+            }
+    }
+    printf("%-14s %8s %9s %9s %9s %9s %10s %8s %8s\n", "generator", "ns/draw", "chi-sq",
+           "serial", "gap", "birthday", "Profit()", "+-", "seconds");
+    for(int g=0; g<count; g++){
+        double (*uniform)(unsigned int)=generators[g].uniform, sum=0, p[4];
+        uniform(seed);
+
+        clock_t start=clock();
+        for(int i=0; i<draws; i++)
+            sum+=uniform(0);
+        double ns=double(clock()-start)/CLOCKS_PER_SEC*1e9/draws;
+        if(sum<0)   // Keeps the timed loop from being optimized away
+            cout << sum;
+
+        p[0]=ChiSquareTest(uniform, draws, 1000, NULL);
+        p[1]=SerialTest(uniform, draws, NULL);
+        p[2]=GapTest(uniform, draws/4, NULL);
+        p[3]=BirthdayTest(uniform, draws/5120, NULL);
+
+        // Profit() stops when its 95% half-width is 5, so the half-width is from
+        // repeated calls
+        double mean=0, mean2=0;
+        const int calls=10;
+        ProfitUniform=uniform;
+        start=clock();
+        for(int c=1; c<=calls; c++){
+            double estimate=Profit(Orders);
+            mean =(mean*(c-1)+estimate)/c;
+            mean2=(mean2*(c-1)+estimate*estimate)/c;
+        }
+        double seconds=double(clock()-start)/CLOCKS_PER_SEC/calls;
+        ProfitUniform=MTUniform;
+
+        printf("%-14s %8.2f", generators[g].name, ns);
+        for(int t=0; t<4; t++)
+            printf(" %8.4f%c", p[t], (p[t]<0.001) ? '*' : ' ');
+        printf(" %10.2f %8.2f %8.4f\n", mean, 1.96*sqrt((mean2-mean*mean)/(calls-1)), seconds);
+    }
+    cout << "* the generator fails the test (p-value below 0.001)\n";
+    return (0);
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////
+// Result sink. The format is picked by the file name's extension: .csv for a header line
+// and a line per strategy, .jsonl for a JSON object per line, and anything else for the
+// binary format: "RMRS", the version and the size of a ResultRecord as ints, then the
+// ResultRecords as they are in memory.
+
+static const int resultVersion=1;
+
+static void ResultWrite(ResultSink *sink, const ResultRecord *rec, int n){
+    for(int k=0; k<n; k++, rec++){
+        if(sink->format==RESULT_BINARY){
+            fwrite(rec, sizeof(ResultRecord), 1, sink->fp);
+            continue;
+        }
+        if(sink->format==RESULT_JSONL)
+            fputs("{\"orders\":[", sink->fp);
+        for(int c=0; c<12; c++)
+            fprintf(sink->fp, (c<11) ? "%d," : "%d", rec->orders[c]);
+        if(sink->format==RESULT_CSV)
+            fprintf(sink->fp, ",%.17g,%.17g,%lld,%lld,%.9g\n", rec->mean, rec->halfWidth,
+                    rec->reps, rec->step, rec->seconds);
+        else
+            fprintf(sink->fp, "],\"mean\":%.17g,\"halfWidth\":%.17g,\"reps\":%lld,\"step\":%lld,"
+                    "\"seconds\":%.9g}\n", rec->mean, rec->halfWidth, rec->reps, rec->step,
+                    rec->seconds);
+    }
+}
+
+#ifndef _WIN32
+// The writer thread: waits for a buffer, writes it out to the file, and hands it back
+static void *ResultWriter(void *arg){
+    ResultSink *sink=(ResultSink *) arg;
+
+    pthread_mutex_lock(&sink->lock);
+    while(1){
+        while(sink->toWrite==0 && !sink->stop)
+            pthread_cond_wait(&sink->ready, &sink->lock);
+        if(sink->toWrite==0)
+            break;
+        int n=sink->toWrite;
+        pthread_mutex_unlock(&sink->lock);
+        ResultWrite(sink, sink->writing, n);   // The search does not touch this buffer
+        fflush(sink->fp);
+        pthread_mutex_lock(&sink->lock);
+        sink->toWrite=0;
+        pthread_cond_signal(&sink->drained);
+    }
+    pthread_mutex_unlock(&sink->lock);
+    return (NULL);
+}
+
+// Give the writer the filled buffer, once it is done with the last one; the lock is held
+static void ResultHandOver(ResultSink *sink){
+    while(sink->toWrite>0)
+        pthread_cond_wait(&sink->drained, &sink->lock);
+    ResultRecord *t=sink->writing;
+    sink->writing=sink->filling;
+    sink->filling=t;
+    sink->toWrite=sink->filled;
+    sink->filled=0;
+    pthread_cond_signal(&sink->ready);
+}
+#endif
+
+// Open fileName for logging, and start the writer thread. Returns 0 if the file cannot
+// be created.
+int ResultSinkOpen(ResultSink *sink, const char *fileName){
+    const char *dot=strrchr(fileName, '.');
+
+    if((sink->fp=fopen(fileName, "wb"))==NULL)
+        return (0);
+    if(dot!=NULL && !strcmp(dot, ".csv"))
+        sink->format=RESULT_CSV;
+    else if(dot!=NULL && !strcmp(dot, ".jsonl"))
+        sink->format=RESULT_JSONL;
+    else
+        sink->format=RESULT_BINARY;
+
+    if(sink->format==RESULT_CSV)
+        fputs("m1,m2,m3,m4,m5,m6,m7,m8,m9,m10,m11,m12,mean,halfWidth,reps,step,seconds\n", sink->fp);
+    if(sink->format==RESULT_BINARY){
+        int size=sizeof(ResultRecord);
+        fwrite("RMRS", 1, 4, sink->fp);
+        fwrite(&resultVersion, sizeof(int), 1, sink->fp);
+        fwrite(&size, sizeof(int), 1, sink->fp);
+    }
+
+    sink->capacity=4096;
+    sink->filling=(ResultRecord *) malloc(sink->capacity*sizeof(ResultRecord));
+    sink->writing=(ResultRecord *) malloc(sink->capacity*sizeof(ResultRecord));
+    sink->filled=sink->toWrite=sink->stop=0;
+    sink->records=0;
+    sink->addSeconds=0;
+#ifndef _WIN32
+    pthread_mutex_init(&sink->lock, NULL);
+    pthread_cond_init(&sink->ready, NULL);
+    pthread_cond_init(&sink->drained, NULL);
+    pthread_create(&sink->writer, NULL, ResultWriter, sink);
+#endif
+    return (1);
+}
+
+// Log n records. The search waits only if the writer has fallen a whole buffer behind.
+void ResultSinkAdd(ResultSink *sink, const ResultRecord rec[], int n){
+    double start=WallSeconds();
+
+#ifndef _WIN32
+    pthread_mutex_lock(&sink->lock);
+    for(int k=0; k<n; k++){
+        if(sink->filled==sink->capacity)
+            ResultHandOver(sink);
+        sink->filling[sink->filled++]=rec[k];
+    }
+    pthread_mutex_unlock(&sink->lock);
+#else
+    ResultWrite(sink, rec, n);   // No writer thread: write in the caller
+#endif
+    sink->records+=n;
+    sink->addSeconds+=WallSeconds()-start;
+}
+
+// Pass the records logged so far to the writer if it is idle, so that they reach the file
+// while the search goes on; if it is still busy they go with the next hand-over. Called at
+// the end of each search step, so a crash loses at most the last few steps' records.
+void ResultSinkFlush(ResultSink *sink){
+    double start=WallSeconds();
+
+#ifndef _WIN32
+    pthread_mutex_lock(&sink->lock);
+    if(sink->filled>0 && sink->toWrite==0)
+        ResultHandOver(sink);
+    pthread_mutex_unlock(&sink->lock);
+#else
+    fflush(sink->fp);
+#endif
+    sink->addSeconds+=WallSeconds()-start;
+}
+
+// Write whatever is left, stop the writer and close the file
+void ResultSinkClose(ResultSink *sink){
+#ifndef _WIN32
+    pthread_mutex_lock(&sink->lock);
+    if(sink->filled>0)
+        ResultHandOver(sink);
+    sink->stop=1;
+    pthread_cond_signal(&sink->ready);
+    pthread_mutex_unlock(&sink->lock);
+    pthread_join(sink->writer, NULL);
+    pthread_mutex_destroy(&sink->lock);
+    pthread_cond_destroy(&sink->ready);
+    pthread_cond_destroy(&sink->drained);
+#endif
+    fclose(sink->fp);
+    free(sink->filling);
+    free(sink->writing);
+}
+
+// results file
+// Runs the order search of main(), logging every strategy it estimates to file (see
+// ResultSinkOpen() for the formats).
+int ResultsMain(int argc, char *argv[]){
+    ResultSink sink;
+    Search search;
+
+    if(argc<1){
+        cout << "usage: results file.csv|file.jsonl|file.bin\n";
+        return (1);
+    }
+    if(!ResultSinkOpen(&sink, argv[0])){
+        cout << "Cannot create " << argv[0] << ".\n";
+        return (1);
+    }
+
+    // Seed the RNG.
+    MTUniform (1);
+    SearchStart(&search, 1);
+    search.sink=&sink;
+
+    OrderSearch(&search, LocalEvaluator, NULL, NULL, 0);
+    ResultSinkClose(&sink);
+
+    cout << "Computations took " << search.seconds << " seconds (" << search.evaluations
+         << " strategies, " << search.replications << " simulated years).\n";
+    cout << "Logged " << sink.records << " strategies to " << argv[0] << ", spending "
+         << sink.addSeconds*1e3 << " ms in the search.\n";
+    return (0);
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////
+// horizon [years [seed]]
+// Runs referenceOrders as a monthly, a weekly and a daily plan
+// (see PeriodOrders()) on the same number of simulated years, and reports the estimated
+// profit of each with the time per year spent simulating the arrivals and per period
+// spent computing the profits, one year at a time and VEC_WIDTH years at a time.
+
+// One horizon's line of the report. The years are simulated in blocks, a row per year,
+// and each block is also copied into a bank with a row per period for the batch kernel.
+template<int H> void HorizonReport(const char *name, int years, unsigned int seed){
+    const int *monthly=referenceOrders, block=1024;
+    int orders[H];
+    Arena *scratch=ThreadArena();
+    size_t mark=ArenaMark(scratch);
+    Matrix byYear=MatrixCreate(block, H, scratch), bank=MatrixCreate(H, block, scratch);
+    double profit[block], mean=0, m2=0, check=0, simulate=0, scalar=0, batch=0;
+    MTState mt;
+
+    PeriodOrders<H>(monthly, orders);
+    MTSeed(&mt, seed);
+
+    for(int first=0; first<years; first+=block){
+        int count=(first+block<years) ? block : years-first;
+
+        double start=WallSeconds();
+        for(int j=0; j<count; j++)
+            PeriodYear<H>(MatrixRow(byYear, j), &mt, 50);
+        simulate+=WallSeconds()-start;
+
+        start=WallSeconds();
+        for(int j=0; j<count; j++)
+            check+=PeriodProfit<H>(MatrixRow(byYear, j), orders);
+        scalar+=WallSeconds()-start;
+
+        for(int p=0; p<H; p++)
+            for(int j=0; j<count; j++)
+                MatrixRow(bank, p)[j]=MatrixRow(byYear, j)[p];
+
+        start=WallSeconds();
+        PeriodProfitBatch<H>(bank, count, orders, profit);
+        batch+=WallSeconds()-start;
+
+        for(int j=0; j<count; j++){
+            mean+=profit[j];
+            m2+=profit[j]*profit[j];
+        }
+    }
+    mean/=years;
+    m2/=years;
+
+    printf("%-8s %6d %10.2f %8.2f %10.2f %10.2f %10.2f\n", name, H, mean,
+           1.96*sqrt((m2-mean*mean)/years), simulate*1e9/years,
+           scalar*1e9/years/H, batch*1e9/years/H);
+    if(fabs(check/years-mean)>1e-6*fabs(mean))
+        printf("   (one year at a time the mean is %.2f)\n", check/years);
+    ArenaRelease(scratch, mark);
+}
+
+int HorizonMain(int argc, char *argv[]){
+    int years=(argc>0) ? atoi(argv[0]) : 100000;
+    unsigned int seed=(argc>1) ? strtoul(argv[1], NULL, 10) : 1;
+
+    if(years<2){
+        cout << "horizon needs at least 2 years.\n";
+        return (1);
+    }
+    printf("%-8s %6s %10s %8s %10s %10s %10s\n", "plan", "period", "profit", "+-",
+           "ns/year", "ns/period", "batched");
+    HorizonReport<12>("monthly", years, seed);
+    HorizonReport<52>("weekly", years, seed);
+    HorizonReport<365>("daily", years, seed);
+    cout << "ns/year is the time to simulate a year's arrivals, ns/period the time per period\n"
+         << "to compute a year's profit, one year at a time and " << VEC_WIDTH << " at a time.\n";
+    return (0);
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////
+// Work-stealing evaluation of a search step. The strategies of a step need very different
+// numbers of years to meet the tolerance, so the work is cut into tasks of one block of
+// 1000 years: simulating a block (shared by all the strategies, as in LocalEvaluator())
+// and scoring one strategy on a block. Each thread has its own queue of tasks, and a
+// thread with nothing to do steals the oldest task of another. Strategies that are still
+// running get further blocks scored ahead of their tolerance check, more of them the
+// fewer strategies are left, and blocks are simulated up to one per thread ahead of the
+// furthest check; the blocks' profits are then taken into each strategy's statistics in
+// order, exactly as LocalEvaluator() does, so the results are the same and scores past a
+// strategy's last block are thrown away.
+
+#ifndef _WIN32
+static const int poolBlock=1000;
+
+static void PoolPush(Pool *pool, int worker, PoolTask task){
+    PoolDeque *d=&pool->deque[worker];
+
+    pthread_mutex_lock(&d->lock);
+    if(d->count==d->size){
+        PoolTask *t=(PoolTask *) malloc(2*d->size*sizeof(PoolTask));
+        for(int k=0; k<d->count; k++)
+            t[k]=d->task[(d->head+k)%d->size];
+        free(d->task);
+        d->task=t;
+        d->head=0;
+        d->size*=2;
+    }
+    d->task[(d->head+d->count++)%d->size]=task;
+    pthread_mutex_unlock(&d->lock);
+    __sync_fetch_and_add(&pool->queued, 1);
+    pool->outstanding++;
+}
+
+// Take a task from the back of the worker's own queue, or else steal one from the front of
+// another's. Returns 0 if all the queues are empty.
+static int PoolTake(Pool *pool, int worker, PoolTask *task){
+    for(int k=0; k<pool->threads; k++){
+        PoolDeque *d=&pool->deque[(worker+k)%pool->threads];
+        pthread_mutex_lock(&d->lock);
+        if(d->count>0){
+            if(k==0)
+                *task=d->task[(d->head+--d->count)%d->size];
+            else{
+                *task=d->task[d->head];
+                d->head=(d->head+1)%d->size;
+                d->count--;
+            }
+            pthread_mutex_unlock(&d->lock);
+            __sync_fetch_and_sub(&pool->queued, 1);
+            if(k>0)
+                __sync_fetch_and_add(&pool->steals, 1);
+            return (1);
+        }
+        pthread_mutex_unlock(&d->lock);
+    }
+    return (0);
+}
+
+// Queue what can run now, onto the worker's own queue; the lock is held
+static void PoolSchedule(Pool *pool, int worker){
+    int window=pool->threads, furthest=0;
+
+    // Each running strategy may have window blocks scored ahead of its check
+    if(pool->running>0){
+        window=(pool->threads+pool->running-1)/pool->running;
+        if(window<1)
+            window=1;
+    }
+    for(int c=0; c<pool->count; c++){
+        if(pool->done[c])
+            continue;
+        if(pool->merged[c]>furthest)
+            furthest=pool->merged[c];
+        while(pool->issued[c]<pool->merged[c]+window && pool->issued[c]<pool->blocks
+              && pool->years[pool->issued[c]]!=NULL){
+            PoolTask task={c, pool->issued[c], pool->years[pool->issued[c]]};
+            PoolPush(pool, worker, task);
+            pool->issued[c]++;
+        }
+    }
+
+    // Simulate blocks up to one per thread past the furthest check
+    while(pool->running>0 && pool->started<furthest+pool->threads){
+        if(pool->started==pool->blocks){
+            pool->blocks=2*pool->blocks+pool->threads;
+            pool->years=(double **) realloc(pool->years, pool->blocks*sizeof(double *));
+            for(int k=pool->started; k<pool->blocks; k++)
+                pool->years[k]=NULL;
+        }
+        PoolTask task={-1, pool->started++, NULL};
+        PoolPush(pool, worker, task);
+    }
+    if(__atomic_load_n(&pool->queued, __ATOMIC_SEQ_CST)>0)
+        pthread_cond_broadcast(&pool->work);
+}
+
+// Take the scored blocks of candidate c that are next in line into its statistics; the
+// lock is held
+static void PoolMerge(Pool *pool, int c){
+    const double epsilon=5.000;
+    ProfitStats *st=&pool->stats[c];
+
+    while(!pool->done[c] && pool->ready[c*pool->threads+pool->merged[c]%pool->threads]){
+        int slot=pool->merged[c]%pool->threads;
+        double *profit=pool->profit+((size_t) c*pool->threads+slot)*poolBlock;
+        for(int r=0; r<poolBlock; r++){
+            st->reps++;
+            st->mean=(st->mean*(st->reps-1)+profit[r])/st->reps;
+            st->m2  =(st->m2*(st->reps-1)+profit[r]*profit[r])/st->reps;
+        }
+        pool->ready[c*pool->threads+slot]=0;
+        pool->merged[c]++;
+        if(1.96*sqrt((st->m2-st->mean*st->mean)/st->reps)<=epsilon){
+            __atomic_store_n(&pool->done[c], 1, __ATOMIC_RELAXED);
+            pool->running--;
+            pool->discarded+=pool->issued[c]-pool->merged[c];
+        }
+    }
+}
+
+static void *PoolWorker(void *arg){
+    Pool *pool=(Pool *) ((void **) arg)[0];
+    int worker=(int) (size_t) ((void **) arg)[1];
+    double profit[poolBlock];
+    PoolTask task;
+
+    free(arg);
+    int node=NumaPin(&pool->numa, worker, NULL);
+    while(1){
+        if(!PoolTake(pool, worker, &task)){
+            pthread_mutex_lock(&pool->lock);
+            while(__atomic_load_n(&pool->queued, __ATOMIC_SEQ_CST)==0 && !pool->stop)
+                pthread_cond_wait(&pool->work, &pool->lock);
+            int stop=pool->stop && __atomic_load_n(&pool->queued, __ATOMIC_SEQ_CST)==0;
+            pthread_mutex_unlock(&pool->lock);
+            if(stop)
+                break;
+            continue;
+        }
+
+        if(task.candidate<0){
+            double *years=(double *) NumaMustAlloc(&pool->numa, poolBlock*12*sizeof(double), node);
+            for(int r=0; r<poolBlock; r++)
+                YearArrivalsAt(years+12*r, pool->seed, task.chunk*poolBlock+r);
+
+            pthread_mutex_lock(&pool->lock);
+            pool->years[task.chunk]=years;
+        }
+        else{
+            int c=task.candidate;
+            // The strategy may have met the tolerance since the task was queued
+            if(!__atomic_load_n(&pool->done[c], __ATOMIC_RELAXED))
+                for(int r=0; r<poolBlock; r++)
+                    profit[r]=ProfitCalc((double *) task.years+12*r, pool->candidates[c]);
+
+            pthread_mutex_lock(&pool->lock);
+            if(!pool->done[c]){
+                int slot=task.chunk%pool->threads;
+                copy(profit, profit+poolBlock, pool->profit+((size_t) c*pool->threads+slot)*poolBlock);
+                pool->ready[c*pool->threads+slot]=1;
+                PoolMerge(pool, c);
+            }
+        }
+        pool->tasks++;
+        PoolSchedule(pool, worker);
+        if(--pool->outstanding==0 && pool->running==0)
+            pthread_cond_broadcast(&pool->idle);
+        pthread_mutex_unlock(&pool->lock);
+    }
+    return (NULL);
+}
+
+// Start a pool of threads, spread over the NUMA nodes
+void PoolStart(Pool *pool, int threads){
+    NumaStart(&pool->numa);
+    pool->threads=threads;
+    pool->thread=(pthread_t *) malloc(threads*sizeof(pthread_t));
+    pool->deque=(PoolDeque *) malloc(threads*sizeof(PoolDeque));
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->work, NULL);
+    pthread_cond_init(&pool->idle, NULL);
+    pool->queued=pool->outstanding=pool->stop=0;
+    pool->count=pool->running=0;
+    pool->years=NULL;
+    pool->blocks=0;
+    pool->tasks=pool->steals=pool->discarded=pool->spare=0;
+
+    for(int w=0; w<threads; w++){
+        PoolDeque *d=&pool->deque[w];
+        pthread_mutex_init(&d->lock, NULL);
+        d->size=64;
+        d->task=(PoolTask *) malloc(d->size*sizeof(PoolTask));
+        d->head=d->count=0;
+    }
+    for(int w=0; w<threads; w++){
+        void **arg=(void **) malloc(2*sizeof(void *));
+        arg[0]=pool;
+        arg[1]=(void *) (size_t) w;
+        pthread_create(&pool->thread[w], NULL, PoolWorker, arg);
+    }
+}
+
+// Start evaluating count strategies with the given seed into stats[], which must stay
+// put until PoolWait() returns
+void PoolSubmit(Pool *pool, int count, int candidates[][12], unsigned int seed, ProfitStats stats[]){
+    pthread_mutex_lock(&pool->lock);
+    pool->count=pool->running=count;
+    pool->candidates=candidates;
+    pool->seed=seed;
+    pool->stats=stats;
+    pool->issued=(int *) calloc(count, sizeof(int));
+    pool->merged=(int *) calloc(count, sizeof(int));
+    pool->done=(int *) calloc(count, sizeof(int));
+    pool->ready=(int *) calloc(count*pool->threads, sizeof(int));
+    pool->profit=(double *) malloc((size_t) count*pool->threads*poolBlock*sizeof(double));
+    pool->started=0;
+    for(int k=0; k<count; k++)
+        stats[k].mean=stats[k].m2=stats[k].reps=0;
+
+    // Spread the first blocks over the threads
+    for(int w=0; w<pool->threads; w++)
+        PoolSchedule(pool, w);
+    pthread_mutex_unlock(&pool->lock);
+}
+
+// Wait until the strategies of the step submitted last have met the tolerance
+void PoolWait(Pool *pool){
+    pthread_mutex_lock(&pool->lock);
+    while(pool->running>0 || pool->outstanding>0)
+        pthread_cond_wait(&pool->idle, &pool->lock);
+
+    int needed=0;
+    for(int c=0; c<pool->count; c++)
+        if(pool->merged[c]>needed)
+            needed=pool->merged[c];
+    pool->spare+=pool->started-needed;
+    for(int k=0; k<pool->started; k++){
+        NumaFree(&pool->numa, pool->years[k]);
+        pool->years[k]=NULL;
+    }
+    free(pool->issued); free(pool->merged); free(pool->done);
+    free(pool->ready); free(pool->profit);
+    pool->count=0;
+    pthread_mutex_unlock(&pool->lock);
+}
+
+// Stop the threads once they have finished, and free the pool
+void PoolStop(Pool *pool){
+    pthread_mutex_lock(&pool->lock);
+    pool->stop=1;
+    pthread_cond_broadcast(&pool->work);
+    pthread_mutex_unlock(&pool->lock);
+    for(int w=0; w<pool->threads; w++){
+        pthread_join(pool->thread[w], NULL);
+        pthread_mutex_destroy(&pool->deque[w].lock);
+        free(pool->deque[w].task);
+    }
+    pthread_mutex_destroy(&pool->lock);
+    pthread_cond_destroy(&pool->work);
+    pthread_cond_destroy(&pool->idle);
+    free(pool->thread);
+    free(pool->deque);
+    free(pool->years);
+    NumaStop(&pool->numa);
+}
+
+// Evaluator that runs a step on the pool given as context
+void PoolEvaluator(int count, int candidates[][12], unsigned int seed, ProfitStats stats[], void *context){
+    Pool *pool=(Pool *) context;
+
+    PoolSubmit(pool, count, candidates, seed, stats);
+    PoolWait(pool);
+}
+#endif
+
+// pool [threads]
+// Runs the order search of main() on a work-stealing pool of threads, one per processor by
+// default, printing the same strategies as main().
+int PoolMain(int argc, char *argv[]){
+#ifndef _WIN32
+    int threads=(argc>0) ? atoi(argv[0]) : (int) sysconf(_SC_NPROCESSORS_ONLN);
+    Search search;
+    Pool pool;
+
+    if(threads<1){
+        cout << "usage: pool [threads]\n";
+        return (1);
+    }
+    PoolStart(&pool, threads);
+
+    // Seed the RNG.
+    MTUniform (1);
+    SearchStart(&search, 1);
+    OrderSearch(&search, PoolEvaluator, &pool, NULL, 0);
+    PoolStop(&pool);
+
+    cout << "Computations took " << search.seconds << " seconds on " << threads << " threads ("
+         << search.evaluations << " strategies, " << search.replications << " simulated years).\n";
+    cout << pool.tasks << " tasks, " << pool.steals << " stolen; " << pool.discarded
+         << " blocks scored and " << pool.spare << " simulated past the tolerance.\n";
+    return (0);
+#else
+    cout << "The pool mode needs POSIX threads.\n";
+    return (1);
+#endif
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////
+// Evaluation service. "serve" runs as a daemon on a Unix domain socket and keeps a bank
+// of simulated years (common random numbers for every strategy) and a cache of answers in
+// memory, so a query costs neither process startup nor simulation, and a repeated query
+// only a table lookup. A client sends any number of requests on one connection:
+//     "RMEQ", int count, then count strategies of 12 ints,
+// at most serviceMaxBatch strategies a request, and gets for each request
+//     "RMEA", int count, then count ServiceAnswers.
+// Everything is in the machine's own byte order, as the socket is local. A malformed
+// request gets an answer with count 0, and the connection is closed. The connections are
+// served together from poll(), so an idle or slow client holds up no one else; an answer
+// that cannot be sent within serviceSendSeconds closes its connection.
+
+#ifndef _WIN32
+static const int serviceMaxBatch=4096;
+static const int serviceSendSeconds=5;
+static volatile sig_atomic_t serviceStop=0;
+
+static void ServiceSignal(int){
+    serviceStop=1;
+}
+
+static unsigned int ServiceHash(const int orders[]){
+    unsigned int h=2166136261u;   // FNV-1a over the bytes of the orders
+    const unsigned char *b=(const unsigned char *) orders;
+    for(size_t k=0; k<12*sizeof(int); k++)
+        h=(h^b[k])*16777619u;
+    return (h);
+}
+
+static void ServiceCacheCreate(ServiceCache *cache, int size){
+    cache->size=size;
+    cache->used=0;
+    cache->orders=(int (*)[12]) malloc(size*sizeof(*cache->orders));
+    cache->answer=(ServiceAnswer *) malloc(size*sizeof(ServiceAnswer));
+    cache->taken=(char *) calloc(size, 1);
+}
+
+static void ServiceCacheFree(ServiceCache *cache){
+    free(cache->orders);
+    free(cache->answer);
+    free(cache->taken);
+}
+
+// The slot of orders in the cache: where it is, or else where it would go
+static int ServiceCacheSlot(const ServiceCache *cache, const int orders[]){
+    int k=ServiceHash(orders)&(cache->size-1);
+    while(cache->taken[k] && memcmp(cache->orders[k], orders, 12*sizeof(int)))
+        k=(k+1)&(cache->size-1);
+    return (k);
+}
+
+static void ServiceCacheAdd(ServiceCache *cache, const int orders[], const ServiceAnswer *answer){
+    if(2*(cache->used+1)>cache->size){
+        ServiceCache bigger;
+        ServiceCacheCreate(&bigger, 2*cache->size);
+        for(int k=0; k<cache->size; k++)
+            if(cache->taken[k])
+                ServiceCacheAdd(&bigger, cache->orders[k], &cache->answer[k]);
+        ServiceCacheFree(cache);
+        *cache=bigger;
+    }
+    int k=ServiceCacheSlot(cache, orders);
+    if(!cache->taken[k]){
+        cache->taken[k]=1;
+        cache->used++;
+        copy(orders, orders+12, cache->orders[k]);
+    }
+    cache->answer[k]=*answer;
+}
+
+// Answer one strategy from the cache, or else from the bank (a row per month)
+static ServiceAnswer ServiceAnswerFor(ServiceCache *cache, Matrix bank, int years, double profit[],
+                                      const int orders[]){
+    ServiceAnswer answer={0, 0, 0, 0, 0};
+    int k=ServiceCacheSlot(cache, orders);
+
+    for(int c=0; c<12; c++)
+        if(orders[c]<0)
+            return (answer);
+    if(cache->taken[k]){
+        answer=cache->answer[k];
+        answer.cached=1;
+        return (answer);
+    }
+
+    double mean=0, m2=0;
+    PeriodProfitBatch<12>(bank, years, orders, profit);
+    for(int j=0; j<years; j++){
+        mean+=profit[j];
+        m2+=profit[j]*profit[j];
+    }
+    mean/=years;
+    m2/=years;
+    answer.mean=mean;
+    answer.halfWidth=1.96*sqrt((m2-mean*mean)/years);
+    answer.years=years;
+    answer.valid=1;
+    ServiceCacheAdd(cache, orders, &answer);
+    return (answer);
+}
+
+// Read what has arrived on a connection. Returns the number of strategies once a whole
+// request is in, 0 if more is to come, and -1 if the connection is to be closed (the client
+// left, or sent a malformed request, which is answered here).
+static int ServiceClientRead(ServiceClient *client){
+    int count=0, need=8;
+
+    if(client->got>=8){
+        memcpy(&count, client->request+4, sizeof(int));
+        need=8+count*(int) sizeof(int[12]);
+    }
+    ssize_t k=read(client->fd, client->request+client->got, need-client->got);
+    if(k<0 && errno==EINTR)
+        return (0);
+    if(k<=0)
+        return (-1);
+    client->got+=(int) k;
+
+    if(client->got==8 && need==8){
+        memcpy(&count, client->request+4, sizeof(int));
+        if(memcmp(client->request, "RMEQ", 4) || count<1 || count>serviceMaxBatch){
+            count=0;
+            WriteAll(client->fd, "RMEA", 4);
+            WriteAll(client->fd, &count, sizeof(int));
+            return (-1);
+        }
+        return (0);
+    }
+    if(client->got<need)
+        return (0);
+    client->got=0;
+    return (count);
+}
+
+// Connect to the service's socket. Returns -1 if that fails.
+static int ServiceConnect(const char *path){
+    struct sockaddr_un addr;
+    int fd=socket(AF_UNIX, SOCK_STREAM, 0);
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family=AF_UNIX;
+    strncpy(addr.sun_path, path, sizeof(addr.sun_path)-1);
+    if(fd<0 || connect(fd, (struct sockaddr *) &addr, sizeof(addr))<0){
+        if(fd>=0)
+            close(fd);
+        return (-1);
+    }
+    return (fd);
+}
+#endif
+
+// serve socket [years [seed]]
+// Runs the evaluation service on the Unix socket socket until interrupted, estimating
+// from a bank of years simulated years (100000 by default) drawn with the given seed.
+int ServeMain(int argc, char *argv[]){
+#ifndef _WIN32
+    int years=(argc>1) ? atoi(argv[1]) : 100000;
+    unsigned int seed=(argc>2) ? strtoul(argv[2], NULL, 10) : 1;
+    struct sockaddr_un addr;
+    struct sigaction action;
+    ServiceCache cache;
+    long long requests=0, queries=0, hits=0;
+    double busy=0;
+
+    if(argc<1 || years<2){
+        cout << "usage: serve socket [years >= 2 [seed]]\n";
+        return (1);
+    }
+    if(strlen(argv[0])>=sizeof(addr.sun_path)){
+        cout << "The socket path " << argv[0] << " is too long.\n";
+        return (1);
+    }
+
+    // The scenario bank, a row per month and a column per year. The service runs on one
+    // thread, so the bank is put on that thread's node rather than copied to every node.
+    Numa numa;
+    NumaStart(&numa);
+    NumaPin(&numa, 0, NULL);
+    int stride=(years+7)/8*8;
+    double start=WallSeconds(), sampleArrivals[12];
+    Matrix bank={(double *) NumaMustAlloc(&numa, 12*(size_t) stride*sizeof(double), 0), 12, years, stride, NULL};
+    double *profit=(double *) malloc(years*sizeof(double));
+    for(int j=0; j<years; j++){
+        YearArrivalsAt(sampleArrivals, seed, j);
+        for(int c=0; c<12; c++)
+            MatrixRow(bank, c)[j]=sampleArrivals[c];
+    }
+    ServiceCacheCreate(&cache, 1024);
+
+    int listener=socket(AF_UNIX, SOCK_STREAM, 0);
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family=AF_UNIX;
+    strcpy(addr.sun_path, argv[0]);
+    // Only a socket left behind by an earlier run is removed, never some other file
+    struct stat old;
+    if(lstat(argv[0], &old)==0 && S_ISSOCK(old.st_mode))
+        unlink(argv[0]);
+    if(listener<0 || bind(listener, (struct sockaddr *) &addr, sizeof(addr))<0
+       || listen(listener, 16)<0){
+        cout << "Cannot listen on " << argv[0] << ".\n";
+        return (1);
+    }
+
+    // Stop on an interrupt, without SA_RESTART so that accept() returns; a client that
+    // goes away must not kill the service
+    memset(&action, 0, sizeof(action));
+    action.sa_handler=ServiceSignal;
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+    signal(SIGPIPE, SIG_IGN);
+    cout << "Serving " << years << " simulated years on " << argv[0] << " (ready in "
+         << WallSeconds()-start << " seconds).\n";
+    cout.flush();
+
+    ServiceAnswer *answers=(ServiceAnswer *) malloc(serviceMaxBatch*sizeof(ServiceAnswer));
+    ServiceClient *client=NULL;
+    struct pollfd *watch=(struct pollfd *) malloc(sizeof(struct pollfd));
+    int clients=0, capacity=0;
+    while(!serviceStop){
+        watch[0].fd=listener;
+        watch[0].events=POLLIN;
+        for(int k=0; k<clients; k++){
+            watch[k+1].fd=client[k].fd;
+            watch[k+1].events=POLLIN;
+        }
+        if(poll(watch, clients+1, -1)<0){
+            if(errno==EINTR)
+                continue;
+            break;
+        }
+
+        // From the last connection back, so that closing one (moving the last into its
+        // place) leaves the ones still to look at where they were
+        for(int k=clients-1; k>=0; k--){
+            if(!(watch[k+1].revents & (POLLIN | POLLHUP | POLLERR)))
+                continue;
+            int count=ServiceClientRead(&client[k]);
+            if(count>0){
+                const int (*orders)[12]=(const int (*)[12]) (client[k].request+8);
+                double begun=WallSeconds();
+                for(int q=0; q<count; q++){
+                    answers[q]=ServiceAnswerFor(&cache, bank, years, profit, (int *) orders[q]);
+                    hits+=answers[q].cached;
+                }
+                requests++;
+                queries+=count;
+                busy+=WallSeconds()-begun;
+
+                if(!WriteAll(client[k].fd, "RMEA", 4) || !WriteAll(client[k].fd, &count, sizeof(int))
+                   || !WriteAll(client[k].fd, answers, count*sizeof(ServiceAnswer)))
+                    count=-1;
+            }
+            if(count<0){
+                close(client[k].fd);
+                free(client[k].request);
+                client[k]=client[--clients];
+            }
+        }
+
+        if(watch[0].revents & POLLIN){
+            int fd=accept(listener, NULL, NULL);
+            if(fd>=0){
+                struct timeval limit={serviceSendSeconds, 0};
+                setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &limit, sizeof(limit));
+                if(clients==capacity){
+                    capacity=2*capacity+4;
+                    client=(ServiceClient *) realloc(client, capacity*sizeof(ServiceClient));
+                    watch=(struct pollfd *) realloc(watch, (capacity+1)*sizeof(struct pollfd));
+                }
+                ServiceClient c={fd, 0, (char *) malloc(8+serviceMaxBatch*sizeof(int[12]))};
+                client[clients++]=c;
+            }
+        }
+    }
+    for(int k=0; k<clients; k++){
+        close(client[k].fd);
+        free(client[k].request);
+    }
+
+    close(listener);
+    unlink(argv[0]);
+    cout << "Answered " << queries << " strategies in " << requests << " requests, " << hits
+         << " from the cache, spending " << busy << " seconds.\n";
+    free(client); free(watch); free(answers); free(profit);
+    NumaStop(&numa);
+    ServiceCacheFree(&cache);
+    return (0);
+#else
+    cout << "The serve mode needs Unix domain sockets.\n";
+    return (1);
+#endif
+}
+
+// query socket orders...
+// Asks the service on socket about the strategies given, 12 numbers each, in one request,
+// and prints the answers with the round-trip time.
+int QueryMain(int argc, char *argv[]){
+#ifndef _WIN32
+    int count=(argc-1)/12;
+
+    if(argc<13 || (argc-1)%12 || count>serviceMaxBatch){
+        cout << "usage: query socket 12 orders [12 orders ...]\n";
+        return (1);
+    }
+    int fd=ServiceConnect(argv[0]);
+    if(fd<0){
+        cout << "Cannot connect to " << argv[0] << ".\n";
+        return (1);
+    }
+
+    int (*orders)[12]=(int (*)[12]) malloc(count*sizeof(*orders));
+    ServiceAnswer *answers=(ServiceAnswer *) malloc(count*sizeof(ServiceAnswer));
+    for(int k=0; k<count; k++)
+        for(int c=0; c<12; c++)
+            orders[k][c]=atoi(argv[1+12*k+c]);
+
+    double start=WallSeconds();
+    char magic[4];
+    int got=0;
+    int ok=WriteAll(fd, "RMEQ", 4) && WriteAll(fd, &count, sizeof(int))
+           && WriteAll(fd, orders, count*sizeof(*orders))
+           && ReadAll(fd, magic, 4) && !memcmp(magic, "RMEA", 4)
+           && ReadAll(fd, &got, sizeof(int)) && got==count
+           && ReadAll(fd, answers, count*sizeof(ServiceAnswer));
+    double seconds=WallSeconds()-start;
+    close(fd);
+
+    if(!ok)
+        cout << "The service did not answer.\n";
+    for(int k=0; ok && k<count; k++){
+        for(int c=0; c<12; c++)
+            cout << orders[k][c] << " ";
+        if(!answers[k].valid)
+            cout << "  rejected\n";
+        else
+            printf("  %.2f +- %.2f (%lld years%s)\n", answers[k].mean, answers[k].halfWidth,
+                   answers[k].years, answers[k].cached ? ", cached" : "");
+    }
+    if(ok)
+        printf("Answered in %.3f ms.\n", seconds*1e3);
+    free(orders);
+    free(answers);
+    return (ok ? 0 : 1);
+#else
+    cout << "The query mode needs Unix domain sockets.\n";
+    return (1);
+#endif
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////
+// isa [n]
+// Times the batch kernels with each instruction set this processor supports (see
+// VecForce()), in ns per value on n values (per year for PeriodProfitBatch()), and checks
+// that each variant's results are bit for bit those of the base variant. The variant
+// picked automatically, or by the environment variable VEC_ISA, is marked.
+int IsaMain(int argc, char *argv[]){
+    const char *names[]={"base", "avx2", "avx512"};
+    const char *kernels[]={"Psi", "PsiInv", "Log", "Exp", "Cos", "Exponential", "Philox", "Profit"};
+    const int kernelCount=8, *orders=referenceOrders;
+    int n=(argc>0) ? atoi(argv[0]) : 1000000;
+    const char *chosen=VecIsa();
+
+    if(n<64){
+        cout << "usage: isa [n >= 64]\n";
+        return (1);
+    }
+    double *x=(double *) malloc(n*sizeof(double)), *u=(double *) malloc(n*sizeof(double));
+    double *y=(double *) calloc(n, sizeof(double)), *base[8];
+    unsigned int *words=(unsigned int *) calloc(4*(size_t) n, sizeof(unsigned int)), *baseWords;
+    unsigned int counter[4]={0, 0, 0, 0}, key[2]={1, 2};
+    Matrix bank=MatrixCreate(12, n, NULL);
+    MTState mt;
+
+    // Uniforms, points in [-10,10] and a bank of years; the outputs are zeroed above so
+    // that no kernel is timed touching fresh pages
+    MTSeed(&mt, 1);
+    for(int i=0; i<n; i++){
+        u[i]=MTStateUniform(&mt);
+        x[i]=20*u[i]-10;
+    }
+    for(int j=0; j<n; j++){
+        double sampleArrivals[12];
+        YearArrivalsAt(sampleArrivals, 1, j);
+        for(int m=0; m<12; m++)
+            MatrixRow(bank, m)[j]=sampleArrivals[m];
+    }
+    for(int k=0; k<kernelCount; k++)
+        base[k]=(double *) malloc(n*sizeof(double));
+    baseWords=(unsigned int *) malloc(4*(size_t) n*sizeof(unsigned int));
+
+    printf("%-8s", "");
+    for(int k=0; k<kernelCount; k++)
+        printf(" %11s", kernels[k]);
+    printf("\n");
+    for(int v=0; v<3; v++){
+        if(!VecSupported(v) || !VecForce(names[v]))
+            continue;
+        int same=1;
+        printf("%-7s%c", names[v], strcmp(names[v], chosen) ? ' ' : '*');
+        for(int k=0; k<kernelCount; k++){
+            double start=WallSeconds();
+            switch(k){
+                case 0: PsiBatch(x, y, n); break;
+                case 1: PsiInvBatch(u, y, n); break;
+                case 2: LogBatch(u, y, n); break;
+                case 3: ExpBatch(x, y, n); break;
+                case 4: CosBatch(x, y, n); break;
+                case 5: ExponentialBatch(u, y, n, 1.0/50); break;
+                case 6: PhiloxBatch(counter, key, words, n); break;
+                case 7: PeriodProfitBatch<12>(bank, n, orders, y); break;
+            }
+            printf(" %11.2f", (WallSeconds()-start)*1e9/n);
+            if(k==6){
+                if(v==0)
+                    copy(words, words+4*(size_t) n, baseWords);
+                same&=!memcmp(words, baseWords, 4*(size_t) n*sizeof(unsigned int));
+            }
+            else{
+                if(v==0)
+                    copy(y, y+n, base[k]);
+                same&=!memcmp(y, base[k], n*sizeof(double));
+            }
+        }
+        printf("  %s\n", same ? "same results" : "RESULTS DIFFER");
+    }
+    VecForce(chosen);
+    cout << "ns per value; * the variant in use (VEC_ISA overrides the choice).\n";
+
+    for(int k=0; k<kernelCount; k++)
+        free(base[k]);
+    free(x); free(u); free(y); free(words); free(baseWords);
+    MatrixFree(&bank);
+    return (0);
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////
+// Demand learnt from historical sales. Profit() draws orders from a Poisson process of 50
+// orders a year spread evenly over the months; a Demand is fitted to the sales of past
+// years instead, so that the seasons and the spread of real sales carry through to the
+// strategies. DemandYears() fills a bank of years that SaaSolve() and ProfitCalc() take
+// just as they take those of YearArrivals(). The monthly draws come from Walker alias
+// tables, a batch of years per month at a time, at a constant cost per draw however
+// wide the distribution.
+#define DEMAND_BATCH 1024   // Years drawn at a time
+
+// Reads the monthly sales of past years from a CSV file, one year per line: twelve
+// counts, January first, optionally after the year itself. Other lines (a header, say)
+// are skipped. Puts the sales in *history, to be freed with free(), and returns the
+// number of years read.
+int DemandRead(double **history, const char *fileName){
+    FILE *fp=fopen(fileName, "r");
+    char line[1024];
+    int n=0, size=16;
+
+    *history=NULL;
+    if(fp==NULL)
+        return (0);
+
+    double *h=(double *) malloc(size*12*sizeof(double));
+    while(fgets(line, sizeof(line), fp)!=NULL){
+        double field[13];
+        int fields=0, valid=1;
+        char *p=line, *end;
+
+        for(;;){
+            double x=strtod(p, &end);
+            if(end==p || fields==13){
+                valid=0;
+                break;
+            }
+            field[fields++]=x;
+            for(p=end; *p==' ' || *p=='\t'; p++);
+            if(*p!=',')
+                break;
+            p++;
+        }
+        if(!valid || fields<12 || (*p!='\0' && *p!='\n' && *p!='\r'))
+            continue;
+        const double *sales=field+fields-12;
+        for(int m=0; m<12; m++)
+            valid&=(sales[m]>=0 && sales[m]<1e9);
+        if(!valid)
+            continue;
+
+        for(int m=0; m<12; m++)
+            h[n*12+m]=floor(sales[m]+0.5);
+        if(++n==size){
+            size*=2;
+            h=(double *) realloc(h, size*12*sizeof(double));
+        }
+    }
+    fclose(fp);
+
+    if(n==0){
+        free(h);
+        h=NULL;
+    }
+    *history=h;
+    return (n);
+}
+
+// Log of the chance of k orders in a month, for a Poisson distribution with the given
+// mean if r is 0, or else a negative binomial with r successes and failure chance q
+static double DemandLogChance(int k, double mean, double r, double q){
+    if(r==0)
+        return (k*log(mean)-mean-lgamma(k+1.0));
+    return (lgamma(k+r)-lgamma(r)-lgamma(k+1.0)+r*log1p(-q)+k*log(q));
+}
+
+// Sets up d to draw years of monthly orders from the given years of past sales (as read
+// by DemandRead()), starting from the given seed:
+//   DEMAND_EMPIRICAL  each month on its own, from that month's past sales, each count as
+//                     often as it was seen;
+//   DEMAND_FITTED     each month on its own, from a Poisson distribution with that
+//                     month's mean, or a negative binomial with its mean and variance if
+//                     sales were more spread out than Poisson allows;
+//   DEMAND_BOOTSTRAP  whole past years, which keeps whatever ties the months of a year
+//                     together, in runs of block consecutive years from random starts
+//                     (wrapping round after the last) to keep some of the ties between
+//                     one year and the next too.
+void DemandCreate(Demand *d, const double history[], int years, int mode, int block, unsigned int seed){
+    d->years=years;
+    d->history=(double *) malloc(years*12*sizeof(double));
+    copy(history, history+years*12, d->history);
+    d->mode=mode;
+    d->block=(block>0) ? block : 1;
+    d->next=0;
+    d->left=0;
+    d->u=(double *) malloc(DEMAND_BATCH*sizeof(double));
+    d->k=(int *) malloc(DEMAND_BATCH*sizeof(int));
+    MTSeed(&d->mt, seed);
+
+    for(int m=0; m<12; m++){
+        double mean=0, m2=0, lo=history[m], hi=history[m];
+        int n;
+
+        d->low[m]=0;
+        d->month[m].n=0;
+        d->month[m].prob=NULL;
+        d->month[m].alias=NULL;
+        if(mode==DEMAND_BOOTSTRAP)
+            continue;
+
+        for(int y=0; y<years; y++){
+            double x=history[y*12+m];
+            mean+=x;
+            m2  +=x*x;
+            lo=fmin(lo, x);
+            hi=fmax(hi, x);
+        }
+        mean/=years;
+        double var=(years>1) ? fmax(0, (m2-years*mean*mean)/(years-1)) : mean;
+        double *w;
+
+        if(mode==DEMAND_EMPIRICAL || mean==0){
+            d->low[m]=int(lo);
+            n=int(hi-lo)+1;
+            w=(double *) calloc(n, sizeof(double));
+            for(int y=0; y<years; y++)
+                w[int(history[y*12+m])-d->low[m]]+=1;
+        }
+        else{
+            // Negative binomial once the variance is 1% over the mean; closer than that
+            // it is Poisson for all practical purposes, and lgamma() of the huge r loses
+            // the digits that matter
+            double r=(var>1.01*mean) ? mean*mean/(var-mean) : 0, q=(r>0) ? mean/(r+mean) : 0;
+            double cut=log(1e-16);
+            int k=0;
+
+            // Counts whose chance is below 1e-16 are left out at both ends
+            while(k<mean && DemandLogChance(k, mean, r, q)<cut)
+                k++;
+            d->low[m]=k;
+            while(k<=mean || DemandLogChance(k, mean, r, q)>=cut)
+                k++;
+            n=k-d->low[m];
+            w=(double *) malloc(n*sizeof(double));
+            for(int i=0; i<n; i++)
+                w[i]=exp(DemandLogChance(d->low[m]+i, mean, r, q));
+        }
+        AliasCreate(&d->month[m], w, n);
+        free(w);
+    }
+}
+
+void DemandFree(Demand *d){
+    for(int m=0; m<12; m++)
+        AliasFree(&d->month[m]);
+    free(d->history);
+    free(d->u);
+    free(d->k);
+}
+
+// Fills each row of bank with a year of monthly orders drawn from d
+void DemandYears(Demand *d, Matrix bank){
+    if(d->mode==DEMAND_BOOTSTRAP){
+        for(int i=0; i<bank.rows; i++){
+            if(d->left==0){
+                d->next=int(MTStateUniform(&d->mt)*d->years);
+                d->left=d->block;
+            }
+            const double *year=d->history+d->next*12;
+            copy(year, year+12, MatrixRow(bank, i));
+            d->next=(d->next+1)%d->years;
+            d->left--;
+        }
+        return;
+    }
+
+    for(int first=0; first<bank.rows; first+=DEMAND_BATCH){
+        int n=(bank.rows-first<DEMAND_BATCH) ? bank.rows-first : DEMAND_BATCH;
+        for(int m=0; m<12; m++){
+            for(int i=0; i<n; i++)
+                d->u[i]=MTStateUniform(&d->mt);
+            AliasDrawBatch(&d->month[m], d->u, d->k, n);
+            for(int i=0; i<n; i++)
+                MatrixRow(bank, first+i)[m]=d->low[m]+d->k[i];
+        }
+    }
+}
+
+// One year of monthly orders drawn from d, in place of YearArrivals(sampleArrivals, mt)
+void DemandYear(Demand *d, double sampleArrivals[]){
+    Matrix year={sampleArrivals, 1, 12, 12, NULL};
+    DemandYears(d, year);
+}
+
+// Fits the demand to the sales in a CSV file, finds the best strategy for it by sample
+// average approximation, and compares that strategy with the one that is best under the
+// Poisson arrivals of Profit(), both on the same fresh years of the fitted demand
+int DemandMain(int argc, char *argv[]){
+    const char *modes[3]={"empirical", "fitted", "bootstrap"};
+    int mode=DEMAND_EMPIRICAL;
+    int N        =(argc>2) ? atoi(argv[2]) : 1000,
+        evalYears=(argc>3) ? atoi(argv[3]) : 100000,
+        block    =(argc>4) ? atoi(argv[4]) : 0;
+    unsigned int seed=(argc>5) ? strtoul(argv[5], NULL, 10) : 1;
+    double *history, monthMean[12], monthVar[12];
+    MTState mt;
+
+    for(mode=0; argc>1 && mode<3 && strcmp(argv[1], modes[mode]); mode++);
+    if(argc<1 || mode==3 || N<1 || evalYears<2 || block<0){
+        cout << "usage: demand salesFile [empirical|fitted|bootstrap [N [evaluationYears [block [seed]]]]]\n";
+        return (1);
+    }
+    if(argc<2)
+        mode=DEMAND_EMPIRICAL;
+    int years=DemandRead(&history, argv[0]);
+    if(years==0){
+        cout << "No years of monthly sales in " << argv[0] << "\n";
+        return (1);
+    }
+    // The usual block length for a block bootstrap, the cube root of the years
+    if(block==0)
+        block=int(cbrt(years)+0.5);
+
+    cout << years << " years of sales; Profit() assumes " << 50/12.0
+         << " orders a month with variance/mean 1\n";
+    cout << "Month   Mean    Variance/mean\n";
+    double total=0;
+    for(int m=0; m<12; m++){
+        double mean=0, m2=0;
+        for(int y=0; y<years; y++){
+            mean+=history[y*12+m];
+            m2  +=history[y*12+m]*history[y*12+m];
+        }
+        monthMean[m]=mean/years;
+        monthVar[m] =(years>1) ? fmax(0, (m2-years*monthMean[m]*monthMean[m])/(years-1)) : 0;
+        total+=monthMean[m];
+        cout << " " << m+1 << "      " << monthMean[m] << "    "
+             << ((monthMean[m]>0) ? monthVar[m]/monthMean[m] : 0) << "\n";
+    }
+    cout << "Orders a year: " << total << "\n";
+    clock_t start=clock();
+
+    Demand d;
+    DemandCreate(&d, history, years, mode, block, seed);
+    Matrix bank   =MatrixCreate(N, 12, NULL),
+           poisson=MatrixCreate(N, 12, NULL),
+           fresh  =MatrixCreate(DEMAND_BATCH, 12, NULL);
+    double drawSeconds=WallSeconds();
+    DemandYears(&d, bank);
+    drawSeconds=WallSeconds()-drawSeconds;
+    MTSeed(&mt, seed^0x5bd1e995u);
+    for(int s=0; s<N; s++)
+        YearArrivals(MatrixRow(poisson, s), &mt);
+
+    // Each search starts from the average monthly orders of its own model
+    int learnt[12], assumed[12];
+    long long simulated=0;
+    for(int m=0; m<12; m++){
+        learnt[m] =int(monthMean[m]+0.5);
+        assumed[m]=int(50/12.0+0.5);
+    }
+    SaaSolve(bank, learnt, 0, 75, &simulated);
+    SaaSolve(poisson, assumed, 0, 75, &simulated);
+
+    // Both strategies on the same fresh years
+    double mean[2]={0, 0}, m2[2]={0, 0}, diffMean=0, diffM2=0;
+    for(int first=0; first<evalYears; first+=DEMAND_BATCH){
+        int n=(evalYears-first<DEMAND_BATCH) ? evalYears-first : DEMAND_BATCH;
+        Matrix chunk=MatrixView(fresh, 0, 0, n, 12);
+        double t=WallSeconds();
+        DemandYears(&d, chunk);
+        drawSeconds+=WallSeconds()-t;
+
+        for(int i=0; i<n; i++){
+            int rep=first+i+1;
+            double p[2]={ProfitCalc(MatrixRow(chunk, i), learnt),
+                         ProfitCalc(MatrixRow(chunk, i), assumed)};
+            for(int s=0; s<2; s++){
+                mean[s]+=(p[s]-mean[s])/rep;
+                m2[s]  +=(p[s]*p[s]-m2[s])/rep;
+            }
+            diffMean+=(p[0]-p[1]-diffMean)/rep;
+            diffM2  +=((p[0]-p[1])*(p[0]-p[1])-diffM2)/rep;
+        }
+    }
+
+    cout << "Planned for     Jan Feb Mar Apr May Jun Jul Aug Sep Oct Nov Dec Cars    Profit\n";
+    for(int s=0; s<2; s++){
+        const int *orders=s ? assumed : learnt;
+        int cars=0;
+        cout << (s ? "Poisson       " : modes[mode]);
+        for(int i=int(strlen(modes[mode])); i<14 && !s; i++)
+            cout << " ";
+        for(int c=0; c<12; c++){
+            cout << "  " << orders[c] << " ";
+            cars+=orders[c];
+        }
+        cout << cars << "    " << mean[s] << " +- " << 1.96*sqrt((m2[s]-mean[s]*mean[s])/evalYears) << "\n";
+    }
+    cout << "Planning for the " << modes[mode] << " demand gains " << diffMean << " +- "
+         << 1.96*sqrt(fmax(0, diffM2-diffMean*diffMean)/evalYears) << " a year\n";
+    cout << "Drew " << (long long) N+evalYears << " years at "
+         << drawSeconds*1e9/((double) N+evalYears) << " ns a year; "
+         << simulated << " years simulated by the searches\n";
+    cout << "Computations took " << double(clock()-start)/CLOCKS_PER_SEC << " seconds.\n";
+
+    DemandFree(&d);
+    MatrixFree(&bank);
+    MatrixFree(&poisson);
+    MatrixFree(&fresh);
+    free(history);
+    return (0);
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////
+// NUMA placement. On a machine with several sockets each has its own memory, and reading
+// another socket's memory crosses the interconnect. NumaStart() finds the nodes and their
+// CPUs, NumaPin() spreads threads over them, and NumaAlloc() puts a block of memory on a
+// node, so that a thread can keep what it works on at hand and read-mostly data can be
+// copied to every node. The nodes come from /sys/devices/system/node; the environment
+// variable NUMA_FAKE=n splits the CPUs into n made-up nodes instead, to try the placement
+// out on a machine with one. Memory is bound with the mbind() system call when there are
+// real nodes to bind it to, and NumaNodeOf() asks the kernel where a page really is, so
+// the reports show what happened rather than what was asked for.
+
+#ifndef _WIN32
+// Read a list such as "0-3,8,10-11" into out[], returning how many numbers it holds
+static int NumaList(const char *s, int out[], int max){
+    int n=0;
+    while(*s>='0' && *s<='9'){
+        char *end;
+        int lo=(int) strtol(s, &end, 10), hi=lo;
+        if(*end=='-')
+            hi=(int) strtol(end+1, &end, 10);
+        for(int k=lo; k<=hi && n<max; k++)
+            out[n++]=k;
+        s=(*end==',') ? end+1 : end;
+    }
+    return (n);
+}
+
+void NumaStart(Numa *numa){
+    const char *fake=getenv("NUMA_FAKE");
+    int cpus=0, max=(int) sysconf(_SC_NPROCESSORS_CONF)+1;
+#ifdef CPU_SETSIZE
+    if(max<CPU_SETSIZE)
+        max=CPU_SETSIZE;
+#endif
+    int *allowed=(int *) malloc(max*sizeof(int)), *list=(int *) malloc(max*sizeof(int));
+
+    // The CPUs this process may run on
+#ifdef __linux__
+    cpu_set_t set;
+    if(sched_getaffinity(0, sizeof(set), &set)==0)
+        for(int c=0; c<CPU_SETSIZE; c++)
+            if(CPU_ISSET(c, &set))
+                allowed[cpus++]=c;
+#endif
+    if(cpus==0){
+        cpus=(int) sysconf(_SC_NPROCESSORS_ONLN);
+        if(cpus<1)
+            cpus=1;
+        for(int c=0; c<cpus; c++)
+            allowed[c]=c;
+    }
+
+    numa->fake=(fake!=NULL && atoi(fake)>0);
+    int most=numa->fake ? atoi(fake) : max;
+    numa->id   =(int *) malloc(most*sizeof(int));
+    numa->first=(int *) malloc((most+1)*sizeof(int));
+    numa->cpu  =(int *) malloc((cpus+most)*sizeof(int));
+    numa->nodes=0;
+    numa->first[0]=0;
+
+    if(numa->fake){
+        // Consecutive runs of CPUs; with fewer CPUs than nodes the nodes share them
+        for(int n=0; n<most; n++){
+            int k=numa->first[n], lo=n*cpus/most, hi=(n+1)*cpus/most;
+            if(lo==hi)
+                numa->cpu[k++]=allowed[n%cpus];
+            for(int c=lo; c<hi; c++)
+                numa->cpu[k++]=allowed[c];
+            numa->id[n]=n;
+            numa->first[++numa->nodes]=k;
+        }
+    }
+    else{
+        char name[64], line[4096];
+        FILE *fp=fopen("/sys/devices/system/node/online", "r");
+        int online=0, *node=(int *) malloc(max*sizeof(int));
+        if(fp!=NULL){
+            if(fgets(line, sizeof(line), fp)!=NULL)
+                online=NumaList(line, node, max);
+            fclose(fp);
+        }
+        // Nodes with memory but none of our CPUs are left out
+        for(int d=0; d<online; d++){
+            sprintf(name, "/sys/devices/system/node/node%d/cpulist", node[d]);
+            if((fp=fopen(name, "r"))==NULL)
+                continue;
+            int n=(fgets(line, sizeof(line), fp)!=NULL) ? NumaList(line, list, max) : 0, k=numa->first[numa->nodes];
+            fclose(fp);
+            for(int i=0; i<n; i++)
+                for(int c=0; c<cpus; c++)
+                    if(allowed[c]==list[i] && k<cpus)
+                        numa->cpu[k++]=list[i];
+            if(k>numa->first[numa->nodes]){
+                numa->id[numa->nodes]=node[d];
+                numa->first[++numa->nodes]=k;
+            }
+        }
+        free(node);
+        if(numa->nodes==0){
+            copy(allowed, allowed+cpus, numa->cpu);
+            numa->id[0]=0;
+            numa->first[1]=cpus;
+            numa->nodes=1;
+        }
+    }
+    numa->bind=(!numa->fake && numa->nodes>1);
+    pthread_mutex_init(&numa->lock, NULL);
+    numa->blocks=0;
+    numa->size=16;
+    numa->block=(NumaBlock *) malloc(numa->size*sizeof(NumaBlock));
+    free(allowed);
+    free(list);
+}
+
+void NumaStop(Numa *numa){
+    while(numa->blocks>0)
+        NumaFree(numa, numa->block[0].addr);
+    pthread_mutex_destroy(&numa->lock);
+    free(numa->block);
+    free(numa->id);
+    free(numa->first);
+    free(numa->cpu);
+}
+
+// Pin the calling thread, the t-th of a group, to a CPU. Consecutive threads go to
+// different nodes, and the threads of a node to its CPUs in turn. Returns the node, and
+// puts the CPU in *cpu unless it is NULL.
+int NumaPin(Numa *numa, int t, int *cpu){
+    int node=t%numa->nodes, n=numa->first[node+1]-numa->first[node];
+    int c=numa->cpu[numa->first[node]+(t/numa->nodes)%n];
+#ifdef __linux__
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(c, &set);
+    pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+#endif
+    if(cpu!=NULL)
+        *cpu=c;
+    return (node);
+}
+
+// bytes of zeroed memory on the given node, whole pages of it, or NULL if there is no
+// memory left. The pages are touched here, so they are placed by the time it returns:
+// bound to the node if there are real nodes, or else where the kernel puts the first
+// touch of the calling thread, which should be pinned to the node.
+void *NumaAlloc(Numa *numa, size_t bytes, int node){
+    size_t page=(size_t) sysconf(_SC_PAGESIZE), length=(bytes+page-1)/page*page;
+    if(length==0)
+        length=page;
+    char *p=(char *) mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if(p==MAP_FAILED)
+        return (NULL);
+
+#ifdef __linux__
+    if(__atomic_load_n(&numa->bind, __ATOMIC_RELAXED) && numa->id[node]<1024){
+        unsigned long mask[1024/(8*sizeof(unsigned long))]={0};
+        int id=numa->id[node], bits=8*sizeof(unsigned long);
+        mask[id/bits]|=1UL<<(id%bits);
+        // MPOL_PREFERRED rather than MPOL_BIND, so that a full node spills over rather
+        // than failing; if the kernel has no NUMA support, stop trying
+        if(syscall(SYS_mbind, p, length, MPOL_PREFERRED, mask, 1024, 0)!=0)
+            __atomic_store_n(&numa->bind, 0, __ATOMIC_RELAXED);
+    }
+#endif
+    memset(p, 0, length);
+
+    pthread_mutex_lock(&numa->lock);
+    if(numa->blocks==numa->size){
+        numa->size*=2;
+        numa->block=(NumaBlock *) realloc(numa->block, numa->size*sizeof(NumaBlock));
+    }
+    NumaBlock b={p, length, node};
+    numa->block[numa->blocks++]=b;
+    pthread_mutex_unlock(&numa->lock);
+    return (p);
+}
+
+// NumaAlloc() for threads that have no way to back out: stops the program when out of
+// memory, as MatrixCreate() does
+void *NumaMustAlloc(Numa *numa, size_t bytes, int node){
+    void *p=NumaAlloc(numa, bytes, node);
+    if(p==NULL){
+        printf("Out of memory for %lu bytes on node %d.\n", (unsigned long) bytes, node);
+        exit(1);
+    }
+    return (p);
+}
+
+void NumaFree(Numa *numa, void *p){
+    if(p==NULL)
+        return;
+    pthread_mutex_lock(&numa->lock);
+    for(int k=0; k<numa->blocks; k++)
+        if(numa->block[k].addr==p){
+            munmap(p, numa->block[k].bytes);
+            numa->block[k]=numa->block[--numa->blocks];
+            break;
+        }
+    pthread_mutex_unlock(&numa->lock);
+}
+
+// The node that the page holding p is on, as far as is known: the kernel says where it is
+// if memory is being bound to real nodes, and otherwise it is taken to be the node that
+// NumaAlloc() was asked for. Returns -1 for memory that did not come from NumaAlloc().
+int NumaNodeOf(Numa *numa, const void *p){
+    int node=-1;
+
+    pthread_mutex_lock(&numa->lock);
+    for(int k=0; k<numa->blocks; k++)
+        if((const char *) p>=numa->block[k].addr && (const char *) p<numa->block[k].addr+numa->block[k].bytes)
+            node=numa->block[k].node;
+    pthread_mutex_unlock(&numa->lock);
+
+#ifdef __linux__
+    int id;
+    if(node>=0 && __atomic_load_n(&numa->bind, __ATOMIC_RELAXED)
+       && syscall(SYS_get_mempolicy, &id, NULL, 0, p, MPOL_F_NODE | MPOL_F_ADDR)==0)
+        for(int n=0; n<numa->nodes; n++)
+            if(numa->id[n]==id)
+                return (n);
+#endif
+    return (node);
+}
+#endif
+
+//////////////////////////////////////////////////////////////////////////////////////////
+// Pipelined simulation. Profit() simulates a year and scores it before going on to the
+// next, but simulating a year is a run of logarithms while scoring it is a short loop of
+// compares and adds, so the two are split into stages on threads of their own: generator
+// threads simulate blocks of years (the years of YearArrivalsAt(), as in LocalEvaluator())
+// and put them in a ring, and evaluator threads take them out and score every strategy on
+// each. The ring is the bounded queue of D. Vyukov: each cell carries a sequence number
+// that says whether it is waiting to be filled or taken, so putting and taking are a
+// compare-and-swap on the tail or head and no thread ever holds a lock. A full ring holds
+// the generators back until the evaluators catch up, and an empty one holds back the
+// evaluators. The buffers travel with the blocks: a thread swaps the one it holds for the
+// one in the cell, so nothing is copied. The sums of each block are kept apart and added
+// up in order of block at the end, so the results do not depend on which thread did what.
+// Threads are pinned to the NUMA nodes in turn and each node has a ring of its own, with
+// its buffers on the node, so a block is normally simulated and scored on one node; an
+// evaluator with nothing in its own ring copies a block out of another node's.
+
+#ifndef _WIN32
+static const int pipeBlock=1024;    // Years per block
+
+static void PipeRingCreate(PipeRing *r, int size, Numa *numa, int node){
+    r->size=size;
+    r->cell=(PipeCell *) NumaMustAlloc(numa, size*sizeof(PipeCell), node);
+    for(int k=0; k<size; k++){
+        r->cell[k].seq=k;
+        r->cell[k].block=-1;
+        r->cell[k].years=(double *) NumaMustAlloc(numa, 12*pipeBlock*sizeof(double), node);
+    }
+    r->head=r->tail=0;
+}
+
+static void PipeRingFree(PipeRing *r, Numa *numa){
+    for(int k=0; k<r->size; k++)
+        NumaFree(numa, r->cell[k].years);
+    NumaFree(numa, r->cell);
+}
+
+// Put block b, held in *years, into the ring, and leave the buffer of the cell it went to in
+// *years. Returns 0 if the ring is full.
+static int PipePut(PipeRing *r, int b, double **years){
+    unsigned long pos=__atomic_load_n(&r->tail, __ATOMIC_RELAXED);
+
+    for(;;){
+        PipeCell *cell=&r->cell[pos&(r->size-1)];
+        long diff=(long) (__atomic_load_n(&cell->seq, __ATOMIC_ACQUIRE)-pos);
+        if(diff<0)
+            return (0);
+        if(diff>0)
+            pos=__atomic_load_n(&r->tail, __ATOMIC_RELAXED);
+        else if(__atomic_compare_exchange_n(&r->tail, &pos, pos+1, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED)){
+            double *filled=*years;
+            *years=cell->years;
+            cell->years=filled;
+            cell->block=b;
+            __atomic_store_n(&cell->seq, pos+1, __ATOMIC_RELEASE);
+            return (1);
+        }
+    }
+}
+
+// Take the oldest block from the ring: its number goes in *b and its buffer in *years, and
+// the buffer that was in *years is left in the cell, or if copy is set the block is copied
+// into *years and the buffers stay where they are. Returns 0 if the ring is empty.
+static int PipeTake(PipeRing *r, int *b, double **years, int copy){
+    unsigned long pos=__atomic_load_n(&r->head, __ATOMIC_RELAXED);
+
+    for(;;){
+        PipeCell *cell=&r->cell[pos&(r->size-1)];
+        long diff=(long) (__atomic_load_n(&cell->seq, __ATOMIC_ACQUIRE)-(pos+1));
+        if(diff<0)
+            return (0);
+        if(diff>0)
+            pos=__atomic_load_n(&r->head, __ATOMIC_RELAXED);
+        else if(__atomic_compare_exchange_n(&r->head, &pos, pos+1, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED)){
+            if(copy)
+                memcpy(*years, cell->years, 12*pipeBlock*sizeof(double));
+            else{
+                double *spare=*years;
+                *years=cell->years;
+                cell->years=spare;
+            }
+            *b=cell->block;
+            __atomic_store_n(&cell->seq, pos+r->size, __ATOMIC_RELEASE);
+            return (1);
+        }
+    }
+}
+
+// Simulate block b into years[], a row per month
+static void PipeSimulate(unsigned int seed, int b, double years[]){
+    double sampleArrivals[12];
+    for(int r=0; r<pipeBlock; r++){
+        YearArrivalsAt(sampleArrivals, seed, (unsigned int) (b*pipeBlock+r));
+        for(int m=0; m<12; m++)
+            years[m*pipeBlock+r]=sampleArrivals[m];
+    }
+}
+
+// Score every strategy on block b, held in years[]
+static void PipeScore(Pipeline *p, int b, double years[], double profit[]){
+    Matrix bank={years, 12, pipeBlock, pipeBlock, NULL};
+    for(int c=0; c<p->count; c++){
+        double sum=0, sum2=0;
+        PeriodProfitBatch<12>(bank, pipeBlock, p->candidates[c], profit);
+        for(int r=0; r<pipeBlock; r++){
+            sum +=profit[r];
+            sum2+=profit[r]*profit[r];
+        }
+        p->sum[b*p->count+c] =sum;
+        p->sum2[b*p->count+c]=sum2;
+    }
+}
+
+// Take a block from the ring of the evaluator's node, or else from another node's if that
+// one is falling behind (more than half full) or the generators have run out of blocks
+static int PipeTakeAny(PipeStage *st, int *b){
+    Pipeline *p=st->pipe;
+    if(PipeTake(&p->ring[st->node], b, &st->spare, 0))
+        return (1);
+    int last=(__atomic_load_n(&p->next, __ATOMIC_RELAXED)>=p->blocks);
+    for(int k=1; k<p->numa->nodes; k++){
+        PipeRing *r=&p->ring[(st->node+k)%p->numa->nodes];
+        long held=(long) (__atomic_load_n(&r->tail, __ATOMIC_RELAXED)-__atomic_load_n(&r->head, __ATOMIC_RELAXED));
+        if((last || 2*held>r->size) && PipeTake(r, b, &st->spare, 1)){
+            st->remote++;
+            return (1);
+        }
+    }
+    return (0);
+}
+
+// Pin the thread and give it a buffer on its node
+static void PipeSettle(PipeStage *st){
+    st->node=NumaPin(st->pipe->numa, st->thread, &st->cpu);
+    st->spare=(double *) NumaMustAlloc(st->pipe->numa, 12*pipeBlock*sizeof(double), st->node);
+}
+
+static void *PipeGenerator(void *arg){
+    PipeStage *st=(PipeStage *) arg;
+    Pipeline *p=st->pipe;
+
+    PipeSettle(st);
+    for(;;){
+        int b=__sync_fetch_and_add(&p->next, 1);
+        if(b>=p->blocks)
+            break;
+        double start=WallSeconds();
+        PipeSimulate(p->seed, b, st->spare);
+        st->busy+=WallSeconds()-start;
+
+        if(!PipePut(&p->ring[st->node], b, &st->spare)){
+            start=WallSeconds();
+            st->waits++;
+            while(!PipePut(&p->ring[st->node], b, &st->spare))
+                sched_yield();
+            st->held+=WallSeconds()-start;
+        }
+        st->blocks++;
+    }
+    return (NULL);
+}
+
+static void *PipeEvaluator(void *arg){
+    PipeStage *st=(PipeStage *) arg;
+    Pipeline *p=st->pipe;
+    int b;
+
+    PipeSettle(st);
+    double *profit=(double *) NumaMustAlloc(p->numa, pipeBlock*sizeof(double), st->node);
+    while(__atomic_load_n(&p->scored, __ATOMIC_ACQUIRE)<p->blocks){
+        if(!PipeTakeAny(st, &b)){
+            double start=WallSeconds();
+            int got;
+            st->waits++;
+            while(!(got=PipeTakeAny(st, &b))
+                  && __atomic_load_n(&p->scored, __ATOMIC_ACQUIRE)<p->blocks)
+                sched_yield();
+            st->held+=WallSeconds()-start;
+            if(!got)
+                break;
+        }
+        double start=WallSeconds();
+        PipeScore(p, b, st->spare, profit);
+        st->busy+=WallSeconds()-start;
+        st->blocks++;
+        __sync_fetch_and_add(&p->scored, 1);
+    }
+    NumaFree(p->numa, profit);
+    return (NULL);
+}
+
+// Add up the blocks' sums of strategy c in order
+static ProfitStats PipeStats(const Pipeline *p, int c){
+    ProfitStats st;
+    double sum=0, sum2=0;
+    for(int b=0; b<p->blocks; b++){
+        sum +=p->sum[b*p->count+c];
+        sum2+=p->sum2[b*p->count+c];
+    }
+    st.reps=p->blocks*pipeBlock;
+    st.mean=sum/st.reps;
+    st.m2  =sum2/st.reps;
+    return (st);
+}
+#endif
+
+// Scores a strategy and its neighbours (one car more or less in one month) on the same
+// years, first one block at a time on one thread, then through the pipeline, and reports
+// how each stage of the pipeline kept up
+int PipelineMain(int argc, char *argv[]){
+#ifndef _WIN32
+    // Simulating a year takes about three times as long as scoring 25 strategies on it
+    int cpus=(int) sysconf(_SC_NPROCESSORS_ONLN), quarter=(cpus>=4) ? cpus/4 : 1;
+    int generators=(argc>0) ? atoi(argv[0]) : (cpus>quarter ? cpus-quarter : 1),
+        evaluators=(argc>1) ? atoi(argv[1]) : quarter,
+        years     =(argc>2) ? atoi(argv[2]) : 1000000,
+        count     =(argc>3) ? atoi(argv[3]) : 25,
+        size      =(argc>4) ? atoi(argv[4]) : 16;
+    const int base[12]={4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4};
+    Pipeline p;
+
+    if(generators<1 || evaluators<1 || years<1 || count<1 || count>25 || size<2 || (size&(size-1))){
+        cout << "usage: pipeline [generators [evaluators [years [strategies (1 to 25) "
+                "[ring cells (a power of 2, at least 2)]]]]]\n";
+        return (1);
+    }
+    p.generators=generators;
+    p.evaluators=evaluators;
+    p.blocks=(years+pipeBlock-1)/pipeBlock;
+    p.seed=1;
+    p.count=count;
+    p.candidates=(int (*)[12]) malloc(count*sizeof(*p.candidates));
+    for(int c=0; c<count; c++){
+        copy(base, base+12, p.candidates[c]);
+        if(c>0)
+            p.candidates[c][(c-1)/2]+=(c%2) ? 1 : -1;
+    }
+    p.sum =(double *) malloc((size_t) p.blocks*count*sizeof(double));
+    p.sum2=(double *) malloc((size_t) p.blocks*count*sizeof(double));
+
+    // One thread, simulating each block and then scoring it
+    double *years1=(double *) malloc(12*pipeBlock*sizeof(double)),
+           *profit=(double *) malloc(pipeBlock*sizeof(double));
+    double simulate=0, score=0;
+    for(int b=0; b<p.blocks; b++){
+        double start=WallSeconds();
+        PipeSimulate(p.seed, b, years1);
+        simulate+=WallSeconds()-start;
+        start=WallSeconds();
+        PipeScore(&p, b, years1, profit);
+        score+=WallSeconds()-start;
+    }
+    ProfitStats *serial=(ProfitStats *) malloc(count*sizeof(ProfitStats));
+    for(int c=0; c<count; c++)
+        serial[c]=PipeStats(&p, c);
+    free(years1);
+    free(profit);
+
+    // The pipeline, with a ring on each node, made from a thread on the node
+    Numa numa;
+    NumaStart(&numa);
+    int threads=generators+evaluators, nodes=numa.nodes;
+    pthread_t *thread=(pthread_t *) malloc(threads*sizeof(pthread_t));
+    PipeStage *stage=(PipeStage *) aligned_alloc(64, threads*sizeof(PipeStage));
+    p.numa=&numa;
+    p.ring=(PipeRing *) aligned_alloc(64, nodes*sizeof(PipeRing));
+    for(int n=0; n<nodes; n++){
+        NumaPin(&numa, n, NULL);
+        PipeRingCreate(&p.ring[n], size, &numa, n);
+    }
+    p.next=0;
+    p.scored=0;
+    p.stage=stage;
+
+    // Both kinds of thread are spread over the nodes, the evaluators of a node pinned to
+    // the CPUs after its generators'
+    for(int t=0; t<threads; t++){
+        int e=t-generators, n=e%nodes;
+        memset(&stage[t], 0, sizeof(PipeStage));
+        stage[t].pipe=&p;
+        stage[t].thread=(t<generators) ? t : n+nodes*((generators-n+nodes-1)/nodes+e/nodes);
+    }
+    double start=WallSeconds();
+    for(int t=0; t<threads; t++)
+        pthread_create(&thread[t], NULL, (t<generators) ? PipeGenerator : PipeEvaluator, &stage[t]);
+    for(int t=0; t<threads; t++)
+        pthread_join(thread[t], NULL);
+    double wall=WallSeconds()-start;
+
+    int same=1, best=0;
+    ProfitStats *piped=(ProfitStats *) malloc(count*sizeof(ProfitStats));
+    for(int c=0; c<count; c++){
+        piped[c]=PipeStats(&p, c);
+        same&=(piped[c].mean==serial[c].mean && piped[c].m2==serial[c].m2);
+        if(piped[c].mean>piped[best].mean)
+            best=c;
+    }
+
+    long long simulated=(long long) p.blocks*pipeBlock;
+    printf("%d strategies on %lld years, in blocks of %d through a ring of %d cells on each of %d %snode%s\n",
+           count, simulated, pipeBlock, size, nodes, numa.fake ? "made-up " : "", (nodes>1) ? "s" : "");
+    printf("One thread:   %8.3f s (simulating %.3f s, scoring %.3f s)\n", simulate+score, simulate, score);
+    printf("Pipeline:     %8.3f s on %d generator and %d evaluator threads, %.2f times as fast\n",
+           wall, generators, evaluators, (simulate+score)/wall);
+    printf("Stage      Thread  Node  CPU  Blocks  Remote  Busy s  Waits  Held s   Years/s\n");
+    for(int t=0; t<threads; t++){
+        PipeStage *st=&stage[t];
+        printf("%-9s  %6d  %4d  %3d  %6lld  %6lld  %6.3f  %5lld  %6.3f  %8.3g\n", (t<generators) ? "generate" : "evaluate",
+               (t<generators) ? t : t-generators, st->node, st->cpu, st->blocks, st->remote,
+               st->busy, st->waits, st->held, (st->busy>0) ? st->blocks*pipeBlock/st->busy : 0);
+    }
+    printf("Generators wait on a full ring, evaluators on an empty one; Remote counts the\n"
+           "blocks an evaluator copied from another node's ring, and its years/s counts\n"
+           "each year once however many strategies it scores.\n");
+    printf("Best strategy: ");
+    for(int m=0; m<12; m++)
+        printf("%d ", p.candidates[best][m]);
+    printf(" %.3f +- %.3f (base %.3f)\n", piped[best].mean,
+           1.96*sqrt((piped[best].m2-piped[best].mean*piped[best].mean)/piped[best].reps), piped[0].mean);
+    printf("Results %s those of one thread.\n", same ? "are the same as" : "DIFFER FROM");
+
+    for(int t=0; t<threads; t++)
+        NumaFree(&numa, stage[t].spare);
+    for(int n=0; n<nodes; n++)
+        PipeRingFree(&p.ring[n], &numa);
+    NumaStop(&numa);
+    free(p.ring);
+    free(stage);
+    free(thread);
+    free(p.candidates);
+    free(p.sum);
+    free(p.sum2);
+    free(serial);
+    free(piped);
+    return (same ? 0 : 1);
+#else
+    cout << "The pipeline mode needs POSIX threads.\n";
+    return (1);
+#endif
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////
+// Scoring strategies on a bank of years with the bank on one node, as the serve mode and
+// the C API keep it, against a copy of the bank and the strategies on every node. The
+// bank is read over and over and never written, so the copies cost one read across the
+// interconnect per node, after which every thread reads its own node's. Each thread keeps
+// its sums on its own node either way, and the sums are added up in order of thread, so
+// both give the same results.
+
+#ifndef _WIN32
+// Copy the bank and strategies of a share onto the node of its thread
+static void *NumaReplicate(void *arg){
+    NumaShare *sh=(NumaShare *) arg;
+    size_t bytes=12*(size_t) sh->bank.stride*sizeof(double);
+
+    sh->node=NumaPin(sh->numa, sh->thread, &sh->cpu);
+    double *data=(double *) NumaMustAlloc(sh->numa, bytes, sh->node);
+    int (*table)[12]=(int (*)[12]) NumaMustAlloc(sh->numa, sh->count*sizeof(*table), sh->node);
+    memcpy(data, sh->bank.data, bytes);
+    memcpy(table, sh->candidates, sh->count*sizeof(*table));
+    sh->bank.data=data;
+    sh->candidates=table;
+    return (NULL);
+}
+
+// Score every strategy of a share on its years
+static void *NumaScore(void *arg){
+    NumaShare *sh=(NumaShare *) arg;
+    size_t bank=12*(size_t) sh->bank.cols*sizeof(double), table=sh->count*sizeof(*sh->candidates);
+
+    sh->node=NumaPin(sh->numa, sh->thread, &sh->cpu);
+    sh->sum=(double *) NumaMustAlloc(sh->numa, (2*sh->count+sh->bank.cols)*sizeof(double), sh->node);
+    double *profit=sh->sum+2*sh->count, start=WallSeconds();
+    for(int c=0; c<sh->count; c++){
+        PeriodProfitBatch<12>(sh->bank, sh->bank.cols, sh->candidates[c], profit);
+        for(int r=0; r<sh->bank.cols; r++){
+            sh->sum[2*c]  +=profit[r];
+            sh->sum[2*c+1]+=profit[r]*profit[r];
+        }
+    }
+    sh->seconds=WallSeconds()-start;
+
+    sh->local=sh->remote=0;
+    if(NumaNodeOf(sh->numa, sh->bank.data)==sh->node)
+        sh->local+=bank;
+    else
+        sh->remote+=bank;
+    if(NumaNodeOf(sh->numa, sh->candidates)==sh->node)
+        sh->local+=table;
+    else
+        sh->remote+=table;
+    return (NULL);
+}
+#endif
+
+int NumaMain(int argc, char *argv[]){
+#ifndef _WIN32
+    int threads=(argc>0) ? atoi(argv[0]) : (int) sysconf(_SC_NPROCESSORS_ONLN),
+        years  =(argc>1) ? atoi(argv[1]) : 200000,
+        count  =(argc>2) ? atoi(argv[2]) : 25;
+    const int base[12]={4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4};
+    double sampleArrivals[12];
+    Numa numa;
+
+    if(threads<1 || years<1 || count<1 || count>25){
+        cout << "usage: numa [threads [years [strategies (1 to 25)]]]   (NUMA_FAKE=nodes makes up nodes)\n";
+        return (1);
+    }
+    NumaStart(&numa);
+    int nodes=numa.nodes;
+    printf("%d %snode%s, memory %s\n", nodes, numa.fake ? "made-up " : "", (nodes>1) ? "s" : "",
+           numa.bind ? "bound to the nodes with mbind()" : "placed by the first touch");
+    for(int n=0; n<nodes; n++){
+        printf("  node %d: CPUs", numa.id[n]);
+        for(int k=numa.first[n]; k<numa.first[n+1]; k++)
+            printf(" %d", numa.cpu[k]);
+        printf("\n");
+    }
+
+    // The bank, a row per month, and the strategies, made on the first node
+    int stride=(years+7)/8*8;
+    NumaPin(&numa, 0, NULL);
+    Matrix master={(double *) NumaMustAlloc(&numa, 12*(size_t) stride*sizeof(double), 0), 12, years, stride, NULL};
+    int (*table)[12]=(int (*)[12]) NumaMustAlloc(&numa, count*sizeof(*table), 0);
+    for(int y=0; y<years; y++){
+        YearArrivalsAt(sampleArrivals, 1, (unsigned int) y);
+        for(int m=0; m<12; m++)
+            MatrixRow(master, m)[y]=sampleArrivals[m];
+    }
+    for(int c=0; c<count; c++){
+        copy(base, base+12, table[c]);
+        if(c>0)
+            table[c][(c-1)/2]+=(c%2) ? 1 : -1;
+    }
+
+    // The copies, each made by a thread on its node
+    NumaShare *replica=(NumaShare *) calloc(nodes, sizeof(NumaShare)),
+              *share  =(NumaShare *) calloc(threads, sizeof(NumaShare));
+    pthread_t *thread=(pthread_t *) malloc((threads>nodes ? threads : nodes)*sizeof(pthread_t));
+    double copySeconds=WallSeconds();
+    for(int n=0; n<nodes; n++){
+        NumaShare sh={&numa, n, 0, 0, master, table, count, NULL, 0, 0, 0};
+        replica[n]=sh;
+        if(n>0)
+            pthread_create(&thread[n], NULL, NumaReplicate, &replica[n]);
+    }
+    for(int n=1; n<nodes; n++)
+        pthread_join(thread[n], NULL);
+    copySeconds=WallSeconds()-copySeconds;
+
+    // Score on the one bank and then on the copies; the threads' years are whole vectors
+    int slice=((years+threads-1)/threads+7)/8*8, same=1;
+    double mean[2][25], m2[2][25];
+    printf("%d strategies on %d years with %d threads\n", count, years, threads);
+    printf("Layout     Seconds  Slowest thread  Local MB  Remote MB\n");
+    for(int layout=0; layout<2; layout++){
+        double wall=WallSeconds(), slowest=0;
+        size_t local=0, remote=0;
+        for(int t=0; t<threads; t++){
+            int from=(t*slice<years) ? t*slice : years, cols=(years-from<slice) ? years-from : slice;
+            const NumaShare *data=layout ? &replica[t%nodes] : &replica[0];
+            NumaShare sh={&numa, t, 0, 0, MatrixView(data->bank, 0, from, 12, cols), data->candidates,
+                          count, NULL, 0, 0, 0};
+            share[t]=sh;
+            pthread_create(&thread[t], NULL, NumaScore, &share[t]);
+        }
+        for(int t=0; t<threads; t++)
+            pthread_join(thread[t], NULL);
+        wall=WallSeconds()-wall;
+
+        for(int c=0; c<count; c++){
+            double sum=0, sum2=0;
+            for(int t=0; t<threads; t++){
+                sum +=share[t].sum[2*c];
+                sum2+=share[t].sum[2*c+1];
+            }
+            mean[layout][c]=sum/years;
+            m2[layout][c]  =sum2/years;
+            same&=(layout==0 || (mean[1][c]==mean[0][c] && m2[1][c]==m2[0][c]));
+        }
+        for(int t=0; t<threads; t++){
+            local +=share[t].local;
+            remote+=share[t].remote;
+            if(share[t].seconds>slowest)
+                slowest=share[t].seconds;
+            if(layout==0)
+                NumaFree(&numa, share[t].sum);
+        }
+        printf("%-9s  %7.3f  %14.3f  %8.1f  %9.1f\n", layout ? "per node" : "shared", wall, slowest,
+               local/1048576.0, remote/1048576.0);
+    }
+    printf("Making the copies took %.3f s.\n", copySeconds);
+    printf("Thread  Node  CPU\n");
+    for(int t=0; t<threads; t++)
+        printf("%6d  %4d  %3d\n", t, numa.id[share[t].node], share[t].cpu);
 
-        // Note: if no cars were sold the second condition specifies that no money is
-        // made, nor is any money spent
+    // Where NumaAlloc()'s memory ended up, by the kernel's account if it binds memory
+    size_t asked=0, elsewhere=0;
+    for(int k=0; k<numa.blocks; k++){
+        if(NumaNodeOf(&numa, numa.block[k].addr)==numa.block[k].node)
+            asked+=numa.block[k].bytes;
+        else
+            elsewhere+=numa.block[k].bytes;
     }
+    printf("Memory in use: %.1f MB on the node it was asked for, %.1f MB elsewhere\n",
+           asked/1048576.0, elsewhere/1048576.0);
 
-    // Check if any cars are left on the lot at the end of the year
-    // if so, sell them at the clearance price
-    if(orders[12]>0)
-        Revenue+=clearance*orders[12];
+    int best=0;
+    for(int c=1; c<count; c++)
+        if(mean[1][c]>mean[1][best])
+            best=c;
+    printf("Best strategy: ");
+    for(int m=0; m<12; m++)
+        printf("%d ", table[best][m]);
+    printf(" %.3f +- %.3f\n", mean[1][best], 1.96*sqrt((m2[1][best]-mean[1][best]*mean[1][best])/years));
+    printf("Results %s with both layouts.\n", same ? "are the same" : "DIFFER");
 
-    return(Revenue-netCost); // Return the simulated profit made for this year
+    NumaStop(&numa);
+    free(replica);
+    free(share);
+    free(thread);
+    return (same ? 0 : 1);
+#else
+    cout << "The numa mode needs POSIX threads.\n";
+    return (1);
+#endif
 }